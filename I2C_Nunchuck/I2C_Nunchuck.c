@@ -1,6 +1,8 @@
 #include <XC.h>
+#include <sys/attribs.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "i2c_engine.h"
  
 // Configuration Bits (somehow XC32 takes care of this)
 #pragma config FNOSC = FRCPLL       // Internal Fast RC oscillator (8 MHz) w/ PLL
@@ -15,19 +17,58 @@
 #define SYSCLK 40000000L
 #define Baud2BRG(desired_baud)( (SYSCLK / (16*desired_baud))-1)
 
-// Use the core timer to wait for 1 ms.
-void wait_1ms(void)
+// I2C clock.  I2CxBRG = (PBCLK/(2*Fsck)) - PBCLK*TPGD - 2, with the 104ns pulse
+// gobbler delay TPGD (section 24 of the family reference manual): 0x0C2 for
+// 100kHz, 0x02C for 400kHz and 0x00E for 1MHz at 40MHz.  Above 100kHz the
+// internal pull-ups are too weak, use 2.2k resistors from SDA and SCL to 3.3V.
+#define I2C_SPEED 400000L
+#define I2C_BRG(fsck) ((SYSCLK/(2*(fsck)))-((SYSCLK/1000000L)*104L/1000L)-2)
+
+// The main loop gets a new Nunchuck frame this many times per second, read in
+// the background every Timer1 interrupt.  Printing is slower, PRINT_HZ.
+#define POLL_HZ  200
+#define PRINT_HZ 10
+
+// Core timer delays in IDLE mode, the same as robotbase/delay.c
+static volatile unsigned char delay_expired;
+
+// Comes back every 20us until delayMs() is done, see robotbase/delay.c
+void __ISR(_CORE_TIMER_VECTOR, IPL2SOFT) CoreTimer_Handler(void)
 {
-    unsigned int ui;
-    _CP0_SET_COUNT(0); // resets the core timer count
+	delay_expired=1;
+	_CP0_SET_COMPARE(_CP0_GET_COUNT()+(SYSCLK/(2*50000)));
+	IFS0CLR=_IFS0_CTIF_MASK;
+}
 
-    // get the core timer count
-    while ( _CP0_GET_COUNT() < (SYSCLK/(2*1000)) );
+void delay_init(void)
+{
+	IEC0CLR=_IEC0_CTIE_MASK;
+	IPC0bits.CTIP=2;
+	IPC0bits.CTIS=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	OSCCONCLR=_OSCCON_SLPEN_MASK; // 'wait' goes to IDLE, the peripherals keep running
+	INTCONbits.MVEC=1;
+	__builtin_enable_interrupts();
 }
 
-void delayMs(int len)
+// 'wait' is a MIPS32 instruction, so this one can not be mips16 code
+void __attribute__((nomips16)) delayMs(int len)
 {
-	while(len--) wait_1ms();
+	unsigned long start=_CP0_GET_COUNT(), ticks;
+
+	if(len<=0) return;
+	ticks=(unsigned long)len*(SYSCLK/(2*1000));
+	if((_CP0_GET_STATUS()&1)==0) // Interrupts disabled
+	{
+		while((_CP0_GET_COUNT()-start)<ticks);
+		return;
+	}
+	delay_expired=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	_CP0_SET_COMPARE(start+ticks);
+	IEC0SET=_IEC0_CTIE_MASK;
+	while(!delay_expired && ((_CP0_GET_COUNT()-start)<ticks)) asm volatile("wait");
+	IEC0CLR=_IEC0_CTIE_MASK;
 }
 
 void UART2Configure(int baud_rate)
@@ -70,7 +111,7 @@ int _mon_getc(int canblock)
     }
 }
 
-void Init_I2C2(void)
+void Init_I2C2(long fsck)
 {
 	// Configure pin RB2, used for SDA2 (pin 6 of DIP28) as digital I/O
     ANSELB &= ~(1<<2); // Set RB2 as a digital I/O
@@ -81,98 +122,122 @@ void Init_I2C2(void)
     TRISB |= (1<<3);   // configure pin RB3 as input
     CNPUB |= (1<<3);   // Enable pull-up resistor for RB3
 
-	I2C2BRG = 0x0C6; // SCL2 = 100kHz with SYSCLK = 40MHz (See table 24-1 in page 24-32, 830 in pdf)
+	I2C2BRG = I2C_BRG(fsck); // See table 24-2 in the I2C section of the reference manual
+	I2C2CONbits.DISSLW = (fsck==400000L)?0:1; // Slew rate control is only for 400kHz
 	I2C2CONbits.ON=1;//turn on I2C
 }
  
-int I2C_byte_write(unsigned char saddr, unsigned char maddr, unsigned char data)
+// Waits for the 'mask' bits of an I2C2 register to clear.  0 if they did not
+// in I2C_TIMEOUT_US: a slave holding SCL low or noise on the bus.
+int I2C_wait(volatile unsigned int * reg, unsigned int mask)
 {
-	I2C2CONbits.SEN = 1;
-	while(I2C2CONbits.SEN); //Wait till Start sequence is completed
+	unsigned long start=_CP0_GET_COUNT();
 
-	I2C2TRN = (saddr << 1);
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+	while(*reg & mask)
+	{
+		if((_CP0_GET_COUNT()-start)>(I2C_TIMEOUT_US*I2C_TICKS_US)) return 0;
+	}
+	return 1;
+}
 
-	I2C2TRN = maddr;
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+// Sets one of SEN, RSEN, PEN, RCEN or ACKEN and waits for it to clear
+int I2C_event(unsigned int mask)
+{
+	I2C2CONSET=mask;
+	return I2C_wait(&I2C2CON, mask)?I2C_OK:I2C_TIMEOUT;
+}
 
+int I2C_send(unsigned char data)
+{
 	I2C2TRN = data;
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+	if(!I2C_wait(&I2C2STAT, _I2C2STAT_TRSTAT_MASK)) return I2C_TIMEOUT; // Check Tx complete
+	if(I2C2STATbits.BCL) return I2C_COLLISION;
+	return I2C2STATbits.ACKSTAT?I2C_NACK:I2C_OK;
+}
+
+// Ends a transfer that went wrong, counts the error and leaves the bus idle
+int I2C_fail(int why)
+{
+	if(why==I2C_NACK)
+	{
+		i2c_stats.nacks++;
+		// The slave is fine, release the bus with a stop
+		if(I2C_event(_I2C2CON_PEN_MASK)==I2C_OK) return why;
+	}
+	else if(why==I2C_COLLISION)
+	{
+		i2c_stats.collisions++;
+		I2C2STATCLR=_I2C2STAT_BCL_MASK;
+		return why;
+	}
+	else
+	{
+		i2c_stats.timeouts++;
+	}
+	i2c_bus_recover();
+	return why;
+}
 
-	I2C2CONbits.PEN = 1; // Terminate communication with stop signal
-	while(I2C2CONbits.PEN); // Wait till stop sequence is completed
+#define I2C_TRY(x) if((r=(x))!=I2C_OK) return I2C_fail(r)
 
-	return 0;
+int I2C_byte_write(unsigned char saddr, unsigned char maddr, unsigned char data)
+{
+	int r;
+
+	I2C_TRY(I2C_event(_I2C2CON_SEN_MASK)); // Start
+	I2C_TRY(I2C_send(saddr << 1));
+	I2C_TRY(I2C_send(maddr));
+	I2C_TRY(I2C_send(data));
+	I2C_TRY(I2C_event(_I2C2CON_PEN_MASK)); // Terminate communication with stop signal
+
+	return I2C_OK;
 }
 
 int I2C_burst_write(unsigned char saddr, unsigned char maddr, int byteCount, unsigned char* data)
 {
-	I2C2CONbits.SEN = 1;
-	while(I2C2CONbits.SEN); //Wait till Start sequence is completed
-
-	I2C2TRN = (saddr << 1);
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+	int r;
 
-	I2C2TRN = maddr;
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+	I2C_TRY(I2C_event(_I2C2CON_SEN_MASK)); // Start
+	I2C_TRY(I2C_send(saddr << 1));
+	I2C_TRY(I2C_send(maddr));
 
     for (; byteCount > 0; byteCount--)
     {
-		I2C2TRN = *data++; // send data
-		while(I2C2STATbits.TRSTAT); // Check Tx complete
+		I2C_TRY(I2C_send(*data++)); // send data
 	}
 
-	I2C2CONbits.PEN = 1; // Terminate communication with stop signal
-	while(I2C2CONbits.PEN); // Wait till stop sequence is completed
+	I2C_TRY(I2C_event(_I2C2CON_PEN_MASK)); // Terminate communication with stop signal
 
-	return 0;
+	return I2C_OK;
 }
 
 int I2C_burstRead(char saddr, char maddr, int byteCount, unsigned char* data)
 {
-	// First we send the address we want to read from:
-	I2C2CONbits.SEN = 1;
-	while(I2C2CONbits.SEN); //Wait till Start sequence is completed
-
-	I2C2TRN = (saddr << 1);
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+	int r;
 
-	I2C2TRN = maddr;
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
-
-	I2C2CONbits.PEN = 1; // Terminate communication with stop signal
-	while(I2C2CONbits.PEN); // Wait till stop sequence is completed
-	
-	// Second: we gatter the data sent by the slave device
-	I2C2CONbits.SEN = 1;
-	while(I2C2CONbits.SEN); //Wait till Start sequence is completed
-	
-	I2C2TRN = ((saddr << 1) | 1); // The receive address has the least significant bit set to 1
-	while(I2C2STATbits.TRSTAT); // Check Tx complete
+	// First we send the address we want to read from:
+	I2C_TRY(I2C_event(_I2C2CON_SEN_MASK)); // Start
+	I2C_TRY(I2C_send(saddr << 1));
+	I2C_TRY(I2C_send(maddr));
+
+	// Second: we gatter the data sent by the slave device.  A repeated start
+	// keeps the bus, no stop and start in between.
+	I2C_TRY(I2C_event(_I2C2CON_RSEN_MASK));
+	I2C_TRY(I2C_send((saddr << 1) | 1)); // The receive address has the least significant bit set to 1
   
     for (; byteCount > 0; byteCount--)
     {
-    	I2C2CONbits.RCEN=1;
-		while(I2C2CONbits.RCEN); // Wait for a byte to arrive
+		I2C_TRY(I2C_event(_I2C2CON_RCEN_MASK)); // Wait for a byte to arrive
 		*data++=I2C2RCV;
-		if(byteCount==0) // We are done, send NACK
-		{
-			I2C2CONbits.ACKDT=1; // Selects NACK
-			I2C2CONbits.ACKEN = 1;
-			while(I2C2CONbits.ACKEN); // Wait till NACK sequence is completed
-		}
-		else // Not done yet, send an ACK 
-		{
-			I2C2CONbits.ACKDT=0; // Selects ACK
-			I2C2CONbits.ACKEN = 1;
-			while(I2C2CONbits.ACKEN); // Wait till ACK sequence is completed
-		}
+		// ACK every byte but the last one.  The NACK tells the slave to let go
+		// of SDA, so the stop can happen.
+		I2C2CONbits.ACKDT=(byteCount==1)?1:0;
+		I2C_TRY(I2C_event(_I2C2CON_ACKEN_MASK));
 	}
 	
-	I2C2CONbits.PEN = 1; // Terminate communication with stop signal
-	while(I2C2CONbits.PEN); // Wait till stop sequence is completed
+	I2C_TRY(I2C_event(_I2C2CON_PEN_MASK)); // Terminate communication with stop signal
 
-	return 0;
+	return I2C_OK;
 }
 
 void nunchuck_init(int print_extension_type)
@@ -200,18 +265,96 @@ void nunchuck_init(int print_extension_type)
 	I2C_burst_write(0x52, 0x40, 4, buf);
 }
 
-void nunchuck_getdata(unsigned char * s)
+int nunchuck_getdata(unsigned char * s)
 {
 	unsigned char i;
+	int r;
 
 	// Start measurement
-	I2C_burstRead(0x52, 0x00, 6, s);
+	r=I2C_burstRead(0x52, 0x00, 6, s);
 
 	// Decrypt received data
 	for(i=0; i<6; i++)
 	{
 		s[i]=(s[i]^0x17)+0x17;
 	}
+	return r;
+}
+ 
+// The same read done by the I2C interrupt in the background: Timer1 starts
+// it, and nunchuck_done() decrypts the frame when it is in.
+static unsigned char nunchuck_reg=0x00;
+static unsigned char nunchuck_raw[6];
+static const I2C_OP nunchuck_ops[]={
+	{I2C_START, 0, 0},
+	{I2C_ADDR, 0x52<<1, 0},
+	{I2C_WRITE, 1, &nunchuck_reg},
+	{I2C_RESTART, 0, 0},
+	{I2C_ADDR, (0x52<<1)|1, 0},
+	{I2C_READ, 6, nunchuck_raw},
+	{I2C_STOP, 0, 0}
+};
+volatile unsigned char nunchuck_frame[6];
+volatile unsigned char nunchuck_ready=0;
+
+void nunchuck_done(I2C_XFER * x)
+{
+	unsigned char i;
+
+	if(x->status!=I2C_OK) return; // Counted in i2c_stats
+	for(i=0; i<6; i++) nunchuck_frame[i]=(nunchuck_raw[i]^0x17)+0x17;
+	nunchuck_ready=1;
+}
+
+I2C_XFER nunchuck_xfer={nunchuck_ops, sizeof(nunchuck_ops)/sizeof(I2C_OP), nunchuck_done};
+
+// Returns 0 if the last read is not over yet
+int nunchuck_start(void)
+{
+	return i2c_submit(&nunchuck_xfer);
+}
+
+// Timer1 starts a read every 1/POLL_HZ seconds.  If the last one is not
+// over yet (a bus problem) this one is skipped.  A read takes well under 1ms,
+// still busy means it is stuck, but the bus recovery busy waits for up to
+// milliseconds, so nunchuck_read() does it from the main loop.
+volatile unsigned char nunchuck_stuck=0;
+
+void __ISR(_TIMER_1_VECTOR, IPL2SOFT) Timer1_Handler(void)
+{
+	IFS0CLR=_IFS0_T1IF_MASK;
+	if(!nunchuck_start()) nunchuck_stuck=1;
+}
+
+void nunchuck_poll(int hz)
+{
+	T1CON=0;
+	TMR1=0;
+	PR1=(SYSCLK/64L)/hz-1;
+	T1CONbits.TCKPS=2; // 1:64
+	IPC1bits.T1IP=2;
+	IPC1bits.T1IS=1;
+	IFS0CLR=_IFS0_T1IF_MASK;
+	IEC0SET=_IEC0_T1IE_MASK;
+	T1CONbits.ON=1;
+}
+
+// Copy the last frame read in the background, 0 if there is no new one
+int nunchuck_read(unsigned char * s)
+{
+	unsigned char i;
+
+	if(nunchuck_stuck)
+	{
+		i2c_abort();
+		nunchuck_stuck=0; // Also set again by the same read during the recovery
+	}
+	if(!nunchuck_ready) return 0;
+	IEC1CLR=_IEC1_I2C2MIE_MASK;
+	for(i=0; i<6; i++) s[i]=nunchuck_frame[i];
+	nunchuck_ready=0;
+	IEC1SET=_IEC1_I2C2MIE_MASK;
+	return 1;
 }
  
 void main(void) 
@@ -219,11 +362,15 @@ void main(void)
 	unsigned char rbuf[6];
  	int joy_x, joy_y, off_x, off_y, acc_x, acc_y, acc_z;
  	char but1, but2;
+ 	int frames=0, rate=0;
+ 	unsigned long second=0;
 	
 	CFGCON = 0;
+	delay_init(); // Sleeping delays, enables interrupts
 
     UART2Configure(115200);  // Configure UART2 for a baud rate of 115200
-    Init_I2C2(); // Configure I2C2
+    Init_I2C2(I2C_SPEED); // Configure I2C2
+    i2c_engine_init(); // Background transactions, nunchuck_start()
 
 	delayMs(1000); // Give PuTTY a chance to start before sending text
 	
@@ -242,9 +389,23 @@ void main(void)
 	off_y=(int)rbuf[1]-128;
 	printf("Offset_X:%4d Offset_Y:%4d\r\n", off_x, off_y);
 
+	nunchuck_poll(POLL_HZ);
+	second=_CP0_GET_COUNT();
 	while(1)
 	{
-		nunchuck_getdata(rbuf);
+		// Sleep until Timer1 and the I2C interrupt bring a new frame
+		if(!nunchuck_read(rbuf))
+		{
+			delayMs(1);
+			continue;
+		}
+		frames++;
+		if((_CP0_GET_COUNT()-second)>=(SYSCLK/2))
+		{
+			second+=SYSCLK/2;
+			rate=frames;
+			frames=0;
+		}
 
 		joy_x=(int)rbuf[0]-128-off_x;
 		joy_y=(int)rbuf[1]-128-off_y;
@@ -261,9 +422,11 @@ void main(void)
 		if (rbuf[5] & 0x40) acc_z+=2;
 		if (rbuf[5] & 0x80) acc_z+=1;
 		
-		printf("Buttons(Z:%c, C:%c) Joystick(%4d, %4d) Accelerometer(%3d, %3d, %3d)\x1b[0J\r",
-			   but1?'1':'0', but2?'1':'0', joy_x, joy_y, acc_x, acc_y, acc_z);
+		// At 115200 baud a line takes about 7ms, too long for every frame
+		if((frames%(POLL_HZ/PRINT_HZ))!=0) continue;
+		printf("Buttons(Z:%c, C:%c) Joystick(%4d, %4d) Accelerometer(%3d, %3d, %3d) %3d/s errors %lu\x1b[0J\r",
+			   but1?'1':'0', but2?'1':'0', joy_x, joy_y, acc_x, acc_y, acc_z, rate,
+			   i2c_stats.nacks+i2c_stats.collisions+i2c_stats.timeouts);
 		fflush(stdout);
-		delayMs(100);
 	}
 }
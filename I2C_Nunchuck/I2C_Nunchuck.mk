@@ -2,17 +2,20 @@ SHELL=cmd
 CC = xc32-gcc
 OBJCPY = xc32-bin2hex
 ARCH = -mprocessor=32MX130F064B
-OBJ = I2C_Nunchuck.o
+OBJ = I2C_Nunchuck.o i2c_engine.o
 PORTN=$(shell type COMPORT.inc)
 
 I2C_Nunchuck.elf: $(OBJ)
-	$(CC) $(ARCH) -o I2C_Nunchuck.elf I2C_Nunchuck.o -mips16 -DXPRJ_default=default -legacy-libc -Wl,-Map=I2C_Nunchuck.map
+	$(CC) $(ARCH) -o I2C_Nunchuck.elf $(OBJ) -mips16 -DXPRJ_default=default -legacy-libc -Wl,-Map=I2C_Nunchuck.map
 	$(OBJCPY) I2C_Nunchuck.elf
 	@echo Success!
    
 I2C_Nunchuck.o: I2C_Nunchuck.c
 	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o I2C_Nunchuck.o I2C_Nunchuck.c -DXPRJ_default=default -legacy-libc
 
+i2c_engine.o: i2c_engine.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o i2c_engine.o i2c_engine.c -DXPRJ_default=default -legacy-libc
+
 clean:
 	@del *.o *.elf *.hex *.map *.d 2>NUL
 	
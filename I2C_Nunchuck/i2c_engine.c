@@ -0,0 +1,238 @@
+// i2c_engine.c:  Interrupt driven I2C2 master.  See i2c_engine.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "i2c_engine.h"
+
+static I2C_XFER * volatile head, * volatile tail;
+static unsigned char op_i;    // Operation running
+static unsigned char byte_i;  // Byte of a write or read
+static unsigned char acking;  // Read: the ACK/NACK of byte_i is going out
+static unsigned char stopping; // Error: the stop condition is going out
+static unsigned char result;
+
+I2C_STATS i2c_stats;
+
+// Get the bus moving for operation op_i of the transaction at the head of the
+// queue.  Every operation ends with a master interrupt.
+static void op_begin(void)
+{
+	const I2C_OP * op=&head->ops[op_i];
+
+	byte_i=0;
+	acking=0;
+	switch(op->op)
+	{
+		case I2C_START:   I2C2CONSET=_I2C2CON_SEN_MASK; break;
+		case I2C_RESTART: I2C2CONSET=_I2C2CON_RSEN_MASK; break;
+		case I2C_ADDR:    I2C2TRN=op->len; break;
+		case I2C_WRITE:   I2C2TRN=op->buf[0]; break;
+		case I2C_READ:    I2C2CONSET=_I2C2CON_RCEN_MASK; break;
+		case I2C_STOP:    I2C2CONSET=_I2C2CON_PEN_MASK; break;
+	}
+}
+
+static void xfer_begin(void)
+{
+	op_i=0;
+	stopping=0;
+	result=I2C_OK;
+	op_begin();
+}
+
+// Done with the transaction at the head of the queue, on to the next one
+static void xfer_end(void)
+{
+	I2C_XFER * x=head;
+
+	head=x->next;
+	if(head==0) tail=0;
+	i2c_stats.transfers++;
+	if(result==I2C_NACK) i2c_stats.nacks++;
+	else if(result==I2C_COLLISION) i2c_stats.collisions++;
+	else if(result==I2C_TIMEOUT) i2c_stats.timeouts++;
+	x->status=result;
+	if(x->done) x->done(x);
+	if(head) xfer_begin();
+}
+
+static void op_next(void)
+{
+	if(++op_i<head->nops) op_begin();
+	else xfer_end(); // A list without a stop: the next transaction starts with a restart
+}
+
+// Something went wrong: release the bus, then end the transaction
+static void fail(unsigned char why)
+{
+	result=why;
+	stopping=1;
+	I2C2CONSET=_I2C2CON_PEN_MASK;
+}
+
+void __ISR(_I2C_2_VECTOR, IPL3SOFT) I2C2_Handler(void)
+{
+	const I2C_OP * op;
+
+	if(IFS1bits.I2C2BIF)
+	{
+		// Bus collision: the module is back to idle, no stop to send
+		IFS1CLR=_IFS1_I2C2BIF_MASK|_IFS1_I2C2MIF_MASK;
+		I2C2STATCLR=_I2C2STAT_BCL_MASK;
+		if(head)
+		{
+			result=I2C_COLLISION;
+			xfer_end();
+		}
+		return;
+	}
+	IFS1CLR=_IFS1_I2C2MIF_MASK;
+	if(head==0) return; // The blocking functions also cause master events
+
+	if(stopping)
+	{
+		xfer_end();
+		return;
+	}
+
+	op=&head->ops[op_i];
+	switch(op->op)
+	{
+		case I2C_ADDR:
+		case I2C_WRITE:
+			if(I2C2STATbits.ACKSTAT)
+			{
+				fail(I2C_NACK);
+				return;
+			}
+			if((op->op==I2C_WRITE) && (++byte_i<op->len))
+			{
+				I2C2TRN=op->buf[byte_i];
+				return;
+			}
+			break;
+
+		case I2C_READ:
+			if(!acking)
+			{
+				op->buf[byte_i]=I2C2RCV;
+				if(byte_i==op->len-1) I2C2CONSET=_I2C2CON_ACKDT_MASK; // NACK the last byte
+				else I2C2CONCLR=_I2C2CON_ACKDT_MASK;
+				I2C2CONSET=_I2C2CON_ACKEN_MASK;
+				acking=1;
+				return;
+			}
+			acking=0;
+			if(++byte_i<op->len)
+			{
+				I2C2CONSET=_I2C2CON_RCEN_MASK;
+				return;
+			}
+			break;
+	}
+	op_next();
+}
+
+void i2c_engine_init(void)
+{
+	head=tail=0;
+	IEC1CLR=_IEC1_I2C2MIE_MASK|_IEC1_I2C2BIE_MASK;
+	IPC9bits.I2C2IP=3;
+	IPC9bits.I2C2IS=0;
+	IFS1CLR=_IFS1_I2C2MIF_MASK|_IFS1_I2C2BIF_MASK;
+	IEC1SET=_IEC1_I2C2MIE_MASK|_IEC1_I2C2BIE_MASK;
+	INTCONbits.MVEC=1;
+}
+
+int i2c_submit(I2C_XFER * x)
+{
+	unsigned int flags;
+
+	if(x->status==I2C_BUSY) return 0;
+	x->status=I2C_BUSY;
+	x->next=0;
+	flags=__builtin_disable_interrupts();
+	if(tail)
+	{
+		tail->next=x;
+		tail=x;
+	}
+	else
+	{
+		head=tail=x;
+		xfer_begin();
+	}
+	if(flags&1) __builtin_enable_interrupts();
+	return 1;
+}
+
+int i2c_idle(void)
+{
+	return head==0;
+}
+
+void i2c_abort(void)
+{
+	IEC1CLR=_IEC1_I2C2MIE_MASK|_IEC1_I2C2BIE_MASK;
+	if(head)
+	{
+		i2c_bus_recover();
+		IFS1CLR=_IFS1_I2C2MIF_MASK|_IFS1_I2C2BIF_MASK;
+		result=I2C_TIMEOUT;
+		xfer_end(); // And start the next one
+	}
+	IEC1SET=_IEC1_I2C2MIE_MASK|_IEC1_I2C2BIE_MASK;
+}
+
+#define SDA (1<<2) // RB2
+#define SCL (1<<3) // RB3
+
+// Half a 100kHz clock
+static void half(void)
+{
+	unsigned long start=_CP0_GET_COUNT();
+
+	while((_CP0_GET_COUNT()-start)<(5*I2C_TICKS_US));
+}
+
+// Let SCL go high, but a slave may hold it low for a while (clock stretching)
+static void scl_release(void)
+{
+	unsigned long start=_CP0_GET_COUNT();
+
+	TRISBSET=SCL;
+	while(((PORTB&SCL)==0) && ((_CP0_GET_COUNT()-start)<(I2C_TIMEOUT_US*I2C_TICKS_US)));
+	half();
+}
+
+// A slave reset in the middle of a read, or noise on SCL, can leave it
+// holding SDA low and waiting for clocks that never come.  With the module
+// off, drive SCL by hand (open drain, switching TRIS with LAT at 0) until
+// the slave lets go of SDA, at most 9 clocks, then send a stop.
+void i2c_bus_recover(void)
+{
+	int j;
+
+	I2C2CONCLR=_I2C2CON_ON_MASK;
+	LATBCLR=SDA|SCL;
+	TRISBSET=SDA;
+	scl_release();
+	for(j=0; (j<9) && ((PORTB&SDA)==0); j++)
+	{
+		TRISBCLR=SCL;
+		half();
+		scl_release();
+	}
+	// Stop: SDA goes high while SCL is high
+	TRISBCLR=SCL;
+	half();
+	TRISBCLR=SDA;
+	half();
+	scl_release();
+	TRISBSET=SDA;
+	half();
+
+	I2C2STATCLR=_I2C2STAT_BCL_MASK|_I2C2STAT_IWCOL_MASK|_I2C2STAT_I2COV_MASK;
+	I2C2CONSET=_I2C2CON_ON_MASK;
+	i2c_stats.recoveries++;
+}
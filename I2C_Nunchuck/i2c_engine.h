@@ -0,0 +1,79 @@
+// i2c_engine.h:  Interrupt driven I2C2 master.
+//
+// A transaction is a list of operations (start, address, write, repeated
+// start, read, stop) that the I2C2 master interrupt works through in the
+// background, one bus event at a time, so the CPU is free (or asleep in
+// delayMs()) while the bytes go by.  Transactions wait in a queue and run one
+// after the other.  When one is over its 'done' function is called from the
+// interrupt with 'status' set.
+//
+// Example, read 6 bytes from register 0 of device 0x52:
+//
+//   static unsigned char reg=0, buf[6];
+//   static const I2C_OP ops[]={
+//     {I2C_START, 0, 0}, {I2C_ADDR, 0x52<<1, 0}, {I2C_WRITE, 1, &reg},
+//     {I2C_RESTART, 0, 0}, {I2C_ADDR, (0x52<<1)|1, 0}, {I2C_READ, 6, buf},
+//     {I2C_STOP, 0, 0}};
+//   static I2C_XFER x={ops, 7, my_done};
+//   i2c_submit(&x);
+//
+// The blocking I2C_xxx() functions in I2C_Nunchuck.c must not be used while
+// a transaction is queued.
+//
+// Nothing here waits forever.  A transaction that does not end (a slave
+// holding SCL low, a missed event) is ended by i2c_abort(), with status
+// I2C_TIMEOUT, after a periodic check such as the one in Timer1_Handler()
+// finds it stuck.  i2c_bus_recover() clocks a stuck slave free.  Both busy
+// wait for up to milliseconds, so call them from the main loop, not from an
+// interrupt.
+
+#ifndef I2C_ENGINE_H
+#define I2C_ENGINE_H
+
+// Operations
+#define I2C_START   0
+#define I2C_RESTART 1
+#define I2C_ADDR    2 // 'len' is the address byte: (address<<1)|read
+#define I2C_WRITE   3 // 'len' bytes from 'buf', at least 1
+#define I2C_READ    4 // 'len' bytes to 'buf', at least 1, the last one gets a NACK
+#define I2C_STOP    5
+
+// Transaction status
+#define I2C_OK        0
+#define I2C_BUSY      1 // Queued or running
+#define I2C_NACK      2 // Address or data byte not acknowledged
+#define I2C_COLLISION 3 // Lost the bus
+#define I2C_TIMEOUT   4 // Did not end in time, the bus was recovered
+
+#define I2C_TIMEOUT_US 1000 // Per phase (start, byte, stop...) in the blocking functions
+#define I2C_TICKS_US   20   // Core timer ticks per microsecond, SYSCLK/2
+
+typedef struct {
+	unsigned char op;
+	unsigned char len;
+	unsigned char * buf;
+} I2C_OP;
+
+typedef struct I2C_XFER {
+	const I2C_OP * ops;
+	unsigned char nops;
+	void (*done)(struct I2C_XFER * x); // From the interrupt, can be 0
+	void * user;                       // For the program
+	volatile unsigned char status;
+	struct I2C_XFER * next;
+} I2C_XFER;
+
+void i2c_engine_init(void); // After Init_I2C2()
+int  i2c_submit(I2C_XFER * x); // 0 if x is still queued or running
+int  i2c_idle(void);
+void i2c_abort(void);       // End the running transaction with I2C_TIMEOUT
+void i2c_bus_recover(void); // SCL pulses and a stop, the module off meanwhile
+
+typedef struct {
+	unsigned long transfers;
+	unsigned long nacks, collisions, timeouts, recoveries;
+} I2C_STATS;
+
+extern I2C_STATS i2c_stats; // Also counts the errors of the blocking functions
+
+#endif
@@ -1,6 +1,8 @@
 #include <XC.h>
+#include <sys/attribs.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "mcp3008.h"
  
 // Configuration Bits (somehow XC32 takes care of this)
 #pragma config FNOSC = FRCPLL       // Internal Fast RC oscillator (8 MHz) w/ PLL
@@ -15,19 +17,54 @@
 #define SYSCLK 40000000L
 #define Baud2BRG(desired_baud)( (SYSCLK / (16*desired_baud))-1)
 
-// Use the core timer to wait for 1 ms.
-void wait_1ms(void)
+// SPI clock for MCP3008_SCK (mcp3008.h).  Rounds so the clock is never
+// faster than asked.
+#define SPI_BRG(fsck) ((SYSCLK+2*(fsck)-1)/(2*(fsck))-1)
+
+// Conversions per second for the background scan, shared by the channels
+#define SCAN_MASK 0xFF
+#define SCAN_HZ   8000L
+
+// Core timer delays in IDLE mode, the same as robotbase/delay.c
+static volatile unsigned char delay_expired;
+
+// Comes back every 20us until delayMs() is done, see robotbase/delay.c
+void __ISR(_CORE_TIMER_VECTOR, IPL2SOFT) CoreTimer_Handler(void)
 {
-    unsigned int ui;
-    _CP0_SET_COUNT(0); // resets the core timer count
+	delay_expired=1;
+	_CP0_SET_COMPARE(_CP0_GET_COUNT()+(SYSCLK/(2*50000)));
+	IFS0CLR=_IFS0_CTIF_MASK;
+}
 
-    // get the core timer count
-    while ( _CP0_GET_COUNT() < (SYSCLK/(2*1000)) );
+void delay_init(void)
+{
+	IEC0CLR=_IEC0_CTIE_MASK;
+	IPC0bits.CTIP=2;
+	IPC0bits.CTIS=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	OSCCONCLR=_OSCCON_SLPEN_MASK; // 'wait' goes to IDLE, the peripherals keep running
+	INTCONbits.MVEC=1;
+	__builtin_enable_interrupts();
 }
 
-void delayMs(int len)
+// 'wait' is a MIPS32 instruction, so this one can not be mips16 code
+void __attribute__((nomips16)) delayMs(int len)
 {
-	while(len--) wait_1ms();
+	unsigned long start=_CP0_GET_COUNT(), ticks;
+
+	if(len<=0) return;
+	ticks=(unsigned long)len*(SYSCLK/(2*1000));
+	if((_CP0_GET_STATUS()&1)==0) // Interrupts disabled
+	{
+		while((_CP0_GET_COUNT()-start)<ticks);
+		return;
+	}
+	delay_expired=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	_CP0_SET_COMPARE(start+ticks);
+	IEC0SET=_IEC0_CTIE_MASK;
+	while(!delay_expired && ((_CP0_GET_COUNT()-start)<ticks)) asm volatile("wait");
+	IEC0CLR=_IEC0_CTIE_MASK;
 }
 
 void UART2Configure(int baud_rate)
@@ -70,7 +107,7 @@ int _mon_getc(int canblock)
     }
 }
 
-char SPI_Write(char a)
+unsigned long SPI_Write(unsigned long a)
 {
 	SPI1BUF = a; // write to buffer for TX
 	while(SPI1STATbits.SPIRBF==0); // wait for transfer complete
@@ -129,27 +166,19 @@ void config_SPI(void)
 	SPI1CON = 0; // Stops and resets the SPI1.
 	rData=SPI1BUF; // clears the receive buffer
 	SPI1STATCLR=0x40; // clear the Overflow
-	SPI1CON=0x10008120; // SPI ON, 8 bits transfer, SMP=1, Master,  SPI mode unknown (looks like 0,0)
-	SPI1BRG=128; // About 150kHz clock frequency
+	SPI1CON=0x10008920; // SPI ON, 32 bits transfer, Master, mode 0,0
+	SPI1BRG=SPI_BRG(MCP3008_SCK);
 }
 
 // Read 10 bits from the MCP3008 ADC converter using the recommended
-// format in the datasheet.
+// format in the datasheet, the three bytes in one 32 bit transfer (see
+// mcp3008.h).  Not while the background scan runs.
 unsigned int volatile GetADC(char channel)
 {
-	unsigned char val;
 	unsigned int adc;
 	
 	LATBbits.LATB0 = 0;  // Select/enable ADC.
-	
-	val=SPI_Write(0x01);
-
-	val=SPI_Write((channel*0x10)|0x80); // Send single/diff* bit, D2, D1, and D0 bits.
-	adc=((val & 0x03)*0x100); // val contains the high part of the result.
-	
-	val=SPI_Write(0x55); // Dummy transmission to get low part of result.
-	adc+=val; // val contains the low part of the result.
-
+	adc=SPI_Write(MCP3008_CMD(channel)) & 0x3FF; // Start bit, single/diff* bit, D2, D1, D0, then the result
 	LATBbits.LATB0 = 1;	// Deselect ADC.
 	
 	return adc;
@@ -160,12 +189,13 @@ unsigned int volatile GetADC(char channel)
  
 void main(void) 
 {
-	unsigned char rbuf[6];
- 	int joy_x, joy_y, off_x, off_y, acc_x, acc_y, acc_z;
- 	char but1, but2;
+	unsigned long sum[8], n[8], total;
+	unsigned int v;
+	int ch, loops;
 	
 	DDPCON = 0;
 	CFGCON = 0;
+	delay_init(); // Sleeping delays, enables interrupts
 
     UART2Configure(115200);  // Configure UART2 for a baud rate of 115200
 
@@ -178,11 +208,35 @@ void main(void)
 	        __FILE__, __DATE__, __TIME__);
     
 	config_SPI();
-    
+	printf("V0=%5.3f, V1=%5.3f\r\n", (GetADC(0)*VREF)/1023.0, (GetADC(1)*VREF)/1023.0);
+
+	// From now on Timer2 reads the channels in the background.  Empty the
+	// rings every 10ms, before they fill up, and every half a second print
+	// the average of what came in and how many samples.
+	for(ch=0; ch<8; ch++) sum[ch]=n[ch]=0;
+	mcp3008_scan_start(SCAN_MASK, SCAN_HZ);
     while(1)
 	{
-		printf("V0=%5.3f, V1=%5.3f\r", (GetADC(0)*VREF)/1023.0, (GetADC(1)*VREF)/1023.0);
-		delayMs(500);
+		for(loops=0; loops<50; loops++)
+		{
+			delayMs(10);
+			for(ch=0; ch<8; ch++)
+			{
+				while(mcp3008_read(ch, &v))
+				{
+					sum[ch]+=v;
+					n[ch]++;
+				}
+			}
+		}
+		total=0;
+		for(ch=0; ch<8; ch++)
+		{
+			total+=n[ch];
+			printf("V%d=%5.3f ", ch, n[ch]?(sum[ch]*VREF)/(n[ch]*1023.0):0.0);
+			sum[ch]=n[ch]=0;
+		}
+		printf("(%lu samples/s, %lu late)\x1b[0J\r", total*2, mcp3008_late);
 	}
 
 }
@@ -2,17 +2,20 @@ SHELL=cmd
 CC = xc32-gcc
 OBJCPY = xc32-bin2hex
 ARCH = -mprocessor=32MX130F064B
-OBJ = SPI_MCP3008.o
+OBJ = SPI_MCP3008.o mcp3008.o
 PORTN=$(shell type COMPORT.inc)
 
 SPI_MCP3008.elf: $(OBJ)
-	$(CC) $(ARCH) -o SPI_MCP3008.elf SPI_MCP3008.o -mips16 -DXPRJ_default=default -legacy-libc -Wl,-Map=SPI_MCP3008.map
+	$(CC) $(ARCH) -o SPI_MCP3008.elf $(OBJ) -mips16 -DXPRJ_default=default -legacy-libc -Wl,-Map=SPI_MCP3008.map
 	$(OBJCPY) SPI_MCP3008.elf
 	@echo Success!
    
 SPI_MCP3008.o: SPI_MCP3008.c
 	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o SPI_MCP3008.o SPI_MCP3008.c -DXPRJ_default=default -legacy-libc
 
+mcp3008.o: mcp3008.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o mcp3008.o mcp3008.c -DXPRJ_default=default -legacy-libc
+
 clean:
 	@del *.o *.elf *.hex *.map *.d 2>NUL
 	
@@ -0,0 +1,117 @@
+// mcp3008.c:  Background scanning of the MCP3008 channels.  See mcp3008.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "mcp3008.h"
+
+#define SYSCLK 40000000L
+#define CS (1<<0) // RB0, pin 4
+
+static volatile unsigned int ring[8][MCP3008_RING];
+static volatile unsigned char head[8], tail[8];
+static volatile unsigned int last[8];
+static unsigned char chan[8], nchan, pos;
+static volatile unsigned char running;
+volatile unsigned long mcp3008_overruns[8];
+volatile unsigned long mcp3008_late;
+
+void __ISR(_TIMER_2_VECTOR, IPL5SOFT) Timer2_Handler(void)
+{
+	unsigned int v;
+	unsigned char ch, h, n;
+
+	IFS0CLR=_IFS0_T2IF_MASK;
+	if(running)
+	{
+		if(SPI1STATbits.SPIRBF==0)
+		{
+			// Still going: the next interrupt gets it, no waiting at IPL5
+			mcp3008_late++;
+			return;
+		}
+		LATBSET=CS;
+		v=SPI1BUF&0x3FF;
+		ch=chan[pos];
+		last[ch]=v;
+		h=head[ch];
+		n=(h+1)&(MCP3008_RING-1);
+		if(n==tail[ch]) mcp3008_overruns[ch]++;
+		else
+		{
+			ring[ch][h]=v;
+			head[ch]=n;
+		}
+		if(++pos>=nchan) pos=0;
+	}
+	LATBCLR=CS;
+	SPI1BUF=MCP3008_CMD(chan[pos]);
+	running=1;
+}
+
+// Timer2 is 16 bits: take the smallest prescaler that fits the period
+void mcp3008_scan_start(unsigned char mask, long hz)
+{
+	static const unsigned int prescale[8]={1, 2, 4, 8, 16, 32, 64, 256};
+	unsigned long period;
+	unsigned char j;
+
+	mcp3008_scan_stop();
+	nchan=0;
+	for(j=0; j<8; j++)
+	{
+		if(mask&(1<<j)) chan[nchan++]=j;
+		head[j]=tail[j]=0;
+		mcp3008_overruns[j]=0;
+	}
+	if(nchan==0) return;
+	pos=0;
+	mcp3008_late=0;
+	if(hz>MCP3008_MAX_HZ) hz=MCP3008_MAX_HZ;
+	if(hz<1) hz=1;
+
+	for(j=0; j<7; j++)
+	{
+		if((SYSCLK/hz)/prescale[j]<=65536L) break;
+	}
+	period=(SYSCLK/hz)/prescale[j];
+	if(period>65536L) period=65536L;
+
+	T2CON=0;
+	TMR2=0;
+	PR2=period-1;
+	T2CONbits.TCKPS=j;
+	IPC2bits.T2IP=5;
+	IPC2bits.T2IS=0;
+	IFS0CLR=_IFS0_T2IF_MASK;
+	IEC0SET=_IEC0_T2IE_MASK;
+	INTCONbits.MVEC=1;
+	T2CONbits.ON=1;
+}
+
+void mcp3008_scan_stop(void)
+{
+	T2CONbits.ON=0;
+	IEC0CLR=_IEC0_T2IE_MASK;
+	if(running)
+	{
+		while(SPI1STATbits.SPIRBF==0);
+		(void)SPI1BUF;
+		LATBSET=CS;
+		running=0;
+	}
+}
+
+int mcp3008_read(unsigned char ch, unsigned int * val)
+{
+	unsigned char t=tail[ch&7];
+
+	if(t==head[ch&7]) return 0;
+	*val=ring[ch&7][t];
+	tail[ch&7]=(t+1)&(MCP3008_RING-1);
+	return 1;
+}
+
+unsigned int mcp3008_last(unsigned char ch)
+{
+	return last[ch&7];
+}
@@ -0,0 +1,38 @@
+// mcp3008.h:  Background scanning of the MCP3008 channels.
+//
+// Timer2 paces the conversions.  Every Timer2 interrupt ends the conversion
+// started by the one before (chip select high, result out of SPI1BUF, into
+// the ring buffer of its channel) and starts the next one on the next
+// channel of the scan, so the SPI transfer itself runs while the CPU does
+// something else.  One conversion is a single 32 bit SPI frame: the start
+// bit and channel go out after 8 leading zeros, which the MCP3008 ignores,
+// and the 10 bit result comes back in the low bits (datasheet figure 6-1).
+//
+// The frame takes 32 SPI clocks, 16us at 2MHz, so the scan can not go faster
+// than MCP3008_MAX_HZ conversions per second in total, shared by the channels
+// in the scan.  A frame that is not over when the next interrupt comes is left
+// for the interrupt after it, and counted in mcp3008_late: that sample time
+// is skipped.  GetADC() must not be used while scanning.
+
+#ifndef MCP3008_H
+#define MCP3008_H
+
+// SPI1 word that converts 'ch' single ended
+#define MCP3008_CMD(ch) ((0x01UL<<16)|((0x80UL|((ch)<<4))<<8))
+
+// SPI clock: at most 3.6MHz with VDD=5V, about 2MHz with VDD=3.3V as wired
+// here (RB1, MISO, is not 5V tolerant) and 1.35MHz with VDD=2.7V
+#define MCP3008_SCK 2000000L
+
+#define MCP3008_RING   64    // Samples per channel, a power of 2
+#define MCP3008_MAX_HZ (MCP3008_SCK/40) // 32 clocks a frame, 8 more for the interrupt and CS
+
+void mcp3008_scan_start(unsigned char mask, long hz); // Channels (bit n for channel n), conversions/s
+void mcp3008_scan_stop(void);
+int  mcp3008_read(unsigned char ch, unsigned int * val); // Oldest sample, 0 if there is none
+unsigned int mcp3008_last(unsigned char ch);             // Newest sample, the ring is not touched
+
+extern volatile unsigned long mcp3008_overruns[8]; // Samples lost to a full ring
+extern volatile unsigned long mcp3008_late;        // Timer2 came before the frame was over
+
+#endif
@@ -9,15 +9,19 @@
 // PIN 5:  MISO
 // PIN 25: SCK
 // PIN 15: CE (RB6)
+// PIN 16: IRQ (RB7, INT0)
 //
 // Jesus Calvino-Fraga (2018-2020)
 //
 
 #include <XC.h>
+#include <sys/attribs.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "nrf24.h"
+#include "transport.h"
+#include "hop.h"
  
 // Configuration Bits (somehow XC32 takes care of this)
 #pragma config FNOSC = FRCPLL       // Internal Fast RC oscillator (8 MHz) w/ PLL
@@ -32,19 +36,46 @@
 #define SYSCLK 40000000L
 #define Baud2BRG(desired_baud)( (SYSCLK / (16*desired_baud))-1)
 
-// Use the core timer to wait for 1 ms.
-void wait_1ms(void)
+// Core timer delays in IDLE mode, the same as robotbase/delay.c
+static volatile unsigned char delay_expired;
+
+// Comes back every 20us until delayMs() is done, see robotbase/delay.c
+void __ISR(_CORE_TIMER_VECTOR, IPL2SOFT) CoreTimer_Handler(void)
 {
-    unsigned int ui;
-    _CP0_SET_COUNT(0); // resets the core timer count
+	delay_expired=1;
+	_CP0_SET_COMPARE(_CP0_GET_COUNT()+(SYSCLK/(2*50000)));
+	IFS0CLR=_IFS0_CTIF_MASK;
+}
 
-    // get the core timer count
-    while ( _CP0_GET_COUNT() < (SYSCLK/(2*1000)) );
+void delay_init(void)
+{
+	IEC0CLR=_IEC0_CTIE_MASK;
+	IPC0bits.CTIP=2;
+	IPC0bits.CTIS=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	OSCCONCLR=_OSCCON_SLPEN_MASK; // 'wait' goes to IDLE, the peripherals keep running
+	INTCONbits.MVEC=1;
+	__builtin_enable_interrupts();
 }
 
-void delayMs(int len)
+// 'wait' is a MIPS32 instruction, so this one can not be mips16 code
+void __attribute__((nomips16)) delayMs(int len)
 {
-	while(len--) wait_1ms();
+	unsigned long start=_CP0_GET_COUNT(), ticks;
+
+	if(len<=0) return;
+	ticks=(unsigned long)len*(SYSCLK/(2*1000));
+	if((_CP0_GET_STATUS()&1)==0) // Interrupts disabled
+	{
+		while((_CP0_GET_COUNT()-start)<ticks);
+		return;
+	}
+	delay_expired=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	_CP0_SET_COMPARE(start+ticks);
+	IEC0SET=_IEC0_CTIE_MASK;
+	while(!delay_expired && ((_CP0_GET_COUNT()-start)<ticks)) asm volatile("wait");
+	IEC0CLR=_IEC0_CTIE_MASK;
 }
 
 void UART2Configure(int baud_rate)
@@ -91,10 +122,35 @@ int _mon_getc(int canblock)
 uint8_t spi_transfer(uint8_t tx)
 {
 	SPI1BUF = tx; // write to buffer for TX
-	while(SPI1STATbits.SPIRBF==0); // wait for transfer complete
+	while(SPI1STATbits.SPIRBE); // wait for transfer complete (enhanced buffer mode)
 	return SPI1BUF; // read and return the received value
 }
 
+// Back to back transfer of 'len' bytes using the enhanced buffer FIFOs: up to
+// SPI_IN_FLIGHT bytes are queued ahead, so the clock never stops between
+// bytes.  'out' can be NULL to send dummy bytes and 'in' NULL to throw the
+// received bytes away.
+#define SPI_IN_FLIGHT 4
+void spi_burst(uint8_t * out, uint8_t * in, uint8_t len)
+{
+	uint8_t sent=0, received=0, c;
+
+	while(received<len)
+	{
+		if((sent<len) && ((sent-received)<SPI_IN_FLIGHT) && !SPI1STATbits.SPITBF)
+		{
+			SPI1BUF = out?out[sent]:0xff;
+			sent++;
+		}
+		if(!SPI1STATbits.SPIRBE)
+		{
+			c=SPI1BUF;
+			if(in) in[received]=c;
+			received++;
+		}
+	}
+}
+
 /* Pinout for DIP28 PIC32MX130
 1 MCLR                                    28 AVDD 
 2 VREF+/CVREF+/AN0/C3INC/RPA0/CTED1/RA0   27 AVSS 
@@ -146,9 +202,10 @@ void config_SPI(void)
 	rData=SPI1BUF; // clears the receive buffer
 	SPI1STATCLR=0x40; // clear the Overflow
 	// SPI ON, 8 bits transfer, SMP=1, Master, SPI mode (0,1)? Anyhow, the nRF24L01
-	// samples in the falling edge of the clock, therefore SMP must be '1'
-	SPI1CON=0x10008320;
-	SPI1BRG=128; // About 150kHz clock frequency
+	// samples in the falling edge of the clock, therefore SMP must be '1'.
+	// ENHBUF=1: 16 byte FIFOs, so bytes can be queued back to back.
+	SPI1CON=0x10018320;
+	SPI1BRG=1; // SYSCLK/(2*(1+1)) = 10MHz, the fastest the nRF24L01 can take
 }
 
 void safe_gets(char *s, int n)
@@ -169,15 +226,121 @@ void safe_gets(char *s, int n)
 	s[j]=0;
 }
 
-uint8_t temp;
 uint8_t data_array[32];
 uint8_t tx_address[] = "TXADD";
 uint8_t rx_address[] = "RXADD";
+// The receiver also listens on pipes 2 to 5, for more transmitters.  These
+// pipes share all but the first address byte with pipe 1 ("TXADD"), so the
+// transmitters send to "2XADD" to "5XADD".
+uint8_t pipe_address[] = "2345";
+uint8_t pipe;
+char ack_reply[32];
+int ack_count=0;
+char line[TP_MAX_MSG+2];
+TP link; // Reliable messages, see transport.h
+HOP hop; // Channel hopping, see hop.h
+#define HOME_CHANNEL 120
+
+// Milliseconds since reset, from the core timer
+unsigned long millis(void)
+{
+	static unsigned long ms=0, last=0, ticks=0;
+	unsigned long now=_CP0_GET_COUNT();
+
+	ticks+=now-last;
+	last=now;
+	ms+=ticks/(SYSCLK/2000);
+	ticks%=(SYSCLK/2000);
+	return ms;
+}
+
+// transport.c sends its packets one at a time, and takes care of the lost ones
+int tp_radio_send(TP * tp, const uint8_t * pkt, uint8_t len)
+{
+	hop_send(&hop, (uint8_t *)pkt, len, millis());
+	return 1;
+}
+
+void tp_deliver(TP * tp, const uint8_t * msg, uint16_t len)
+{
+	printf("TP: %.*s\r\n", len, msg);
+}
+
+void PrintStats(void)
+{
+	TP_STATS * s=&link.stats;
+
+	printf("> sent %lu msgs %lu pkts (%lu resent), got %lu msgs %lu bytes, %lu dups, rtt %lu/%lu ms\r\n",
+	       s->msgs_sent, s->pkts_sent, s->retransmits, s->msgs_received, s->bytes_delivered, s->dups,
+	       s->rtt_count?s->rtt_sum/s->rtt_count:0, s->rtt_max);
+}
+
+void PrintHop(void)
+{
+	HOP_STATS * s=&hop.stats;
+	int j;
+
+	printf("> channel %d (home %d), table:", hop.channel, hop.home);
+	for(j=0; j<=HOP_CHANNELS; j++) printf(" %d", hop.table[j]);
+	printf("\r\n> hops %lu (%lu failed), searches %lu (%lu found), beacons %lu, lost %lu\r\n",
+	       s->hops, s->hop_fails, s->searches, s->found, s->beacons, s->lost);
+}
+
+// Type 'scan' to see how busy every channel is: the number of received
+// power detector hits out of HOP_SCAN_PASSES, one line per 10 channels
+void PrintScan(void)
+{
+	int j;
+
+	for(j=0; j<=HOP_LAST-HOP_FIRST; j++)
+	{
+		if((j%10)==0) printf("\r\n> %3d:", j+HOP_FIRST);
+		printf(" %2d", hop.hits[j]);
+	}
+	printf("\r\n");
+}
+
+// Type 'burst' to stream BURST_PACKETS full size packets and see the
+// throughput.  The radio stays in TX mode for the whole burst.  If the TX
+// FIFO has no room for BURST_STALL_MS (no IRQ, no radio) the burst stops and
+// the packets not sent count as lost.
+#define BURST_PACKETS  200
+#define BURST_STALL_MS 100
+void BurstTest(void)
+{
+	uint8_t buf[32];
+	unsigned long start, t, ms;
+	uint16_t lost;
+	uint8_t sent;
+	int i;
+
+	for(i=0; i<31; i++) buf[i]='A'+(i%26);
+	buf[31]=0;
+
+	start=_CP0_GET_COUNT();
+	nrf24_streamBegin();
+	for(i=0; i<BURST_PACKETS; i++)
+	{
+		t=_CP0_GET_COUNT();
+		do
+		{
+			sent=nrf24_streamWrite(buf, 32, 0);
+		} while(!sent && ((_CP0_GET_COUNT()-t)<=(SYSCLK/2000)*BURST_STALL_MS));
+		if(!sent) break;
+	}
+	lost=nrf24_streamEnd()+(BURST_PACKETS-i);
+	ms=(_CP0_GET_COUNT()-start)/(SYSCLK/2000);
+	if(ms==0) ms=1;
+
+	printf("> %d packets in %lu ms, %u lost, %lu bits/s\r\n", BURST_PACKETS, ms, lost,
+	       ((unsigned long)(BURST_PACKETS-lost)*32*8*1000)/ms);
+}
  
 void main(void) 
 {
 	DDPCON = 0;
 	CFGCON = 0;
+	delay_init(); // Sleeping delays, enables interrupts
 
     UART2Configure(115200);  // Configure UART2 for a baud rate of 115200
 
@@ -201,7 +364,10 @@ void main(void)
 	config_SPI();
     
     nrf24_init(); // init hardware pins
-    nrf24_config(120,32); // Configure channel and payload size
+    nrf24_config(HOME_CHANNEL,32); // Configure channel and payload size
+    nrf24_useIrq(1); // Events come from the IRQ pin, no more STATUS polling
+    nrf24_dynamicPayloads(1); // Short packets for short messages, replies in the ACK
+    tp_init(&link, 0);
 
     /* Set the device addresses */
     if(PORTA&(1<<3))
@@ -215,44 +381,92 @@ void main(void)
     	printf("Set as receiver\r\n");
 	    nrf24_tx_address(rx_address);
 	    nrf24_rx_address(tx_address);
+	    for(pipe=2; pipe<=5; pipe++) nrf24_pipeConfig(pipe, &pipe_address[pipe-2], 32);
+    }
+
+	// The transmitter picks the channels to hop to, the receiver follows
+    hop_init(&hop, (PORTA&(1<<3))?1:0, HOME_CHANNEL);
+    if(hop.master)
+    {
+    	hop_scan(&hop);
+    	PrintHop();
     }
 
     while(1)
     {    
         if(nrf24_dataReady())
         {
-            nrf24_getData(data_array);
-        	printf("IN: %s\r\n", data_array);
+            pipe=nrf24_getData(data_array);
+            if(hop_input(&hop, data_array, nrf24_rxLength(), millis())) continue;
+            // The transport runs with the one node on pipe 1 (its ACK payloads come on pipe 0)
+            if((pipe<=1) && ((data_array[0]==TP_DATA) || (data_array[0]==TP_ACK)))
+            {
+            	tp_input(&link, data_array, nrf24_rxLength(), millis());
+            }
+            else
+            {
+	        	if(pipe>1) printf("IN(%d): %s\r\n", pipe, data_array);
+	        	else printf("IN: %s\r\n", data_array);
+	        	// The receiver answers in the auto acknowledge of the next message,
+	        	// so the reply costs no extra packet and no turnaround.
+	        	if((PORTA&(1<<3))==0)
+	        	{
+	        		sprintf(ack_reply, "ACK %d", ++ack_count);
+	        		nrf24_ackPayload(pipe, (uint8_t *)ack_reply, strlen(ack_reply)+1);
+	        	}
+	        }
         }
+        tp_poll(&link, millis());
+        hop_poll(&hop, millis());
         
         if(U2STAbits.URXDA) // Something arrived from the serial port?
         {
-        	safe_gets(data_array, sizeof(data_array));
+        	safe_gets(line, sizeof(line));
 		    printf("\r\n");    
-	        nrf24_send(data_array);        
-		    while(nrf24_isSending());
-		    temp = nrf24_lastMessageStatus();
-			if(temp == NRF24_MESSAGE_LOST)
+		    if(strcmp(line, "burst")==0)
+		    {
+		    	BurstTest();
+		    	continue;
+		    }
+		    if(strcmp(line, "stats")==0)
+		    {
+		    	PrintStats();
+		    	PrintHop();
+		    	continue;
+		    }
+		    if(strcmp(line, "scan")==0)
+		    {
+		    	if(hop.master) hop_scan(&hop);
+		    	else nrf24_scan(HOP_FIRST, HOP_LAST, HOP_SCAN_PASSES, hop.hits);
+		    	PrintScan();
+		    	PrintHop();
+		    	continue;
+		    }
+		    if(line[0]=='>')
+		    {
+		    	// '>text' goes through the transport: up to TP_MAX_MSG characters,
+		    	// delivered complete, once and in order
+		    	if(!tp_send(&link, (uint8_t *)&line[1], strlen(&line[1]))) printf("> Transport busy\r\n");
+		    	continue;
+		    }
+		    line[sizeof(data_array)-1]=0;
+		    strcpy(data_array, line);
+	        // Only the text goes on the air.  Back to RX directly, no power down and up.
+			if(!hop_send(&hop, data_array, strlen(data_array)+1, millis()))
 		    {                    
 		        printf("> Message lost\r\n");    
 		    }
-			nrf24_powerDown();
-    		nrf24_powerUpRx();
 		}
 		
 		if((PORTB&(1<<5))==0)
 		{
 			while((PORTB&(1<<5))==0);
 			strcpy(data_array, "Button test");
-	        nrf24_send(data_array);
-		    while(nrf24_isSending());
-		    temp = nrf24_lastMessageStatus();
-			if(temp == NRF24_MESSAGE_LOST)
+	        // Only the text goes on the air.  Back to RX directly, no power down and up.
+			if(!hop_send(&hop, data_array, strlen(data_array)+1, millis()))
 		    {                    
 		        printf("> Message lost\r\n");    
 		    }
-			nrf24_powerDown();
-    		nrf24_powerUpRx();
 		}
     }
 }
@@ -2,7 +2,7 @@ SHELL=cmd
 CC = xc32-gcc
 OBJCPY = xc32-bin2hex
 ARCH = -mprocessor=32MX130F064B
-OBJ = SPI_nRF24L01.o nrf24.o radioPinFunctions.o
+OBJ = SPI_nRF24L01.o nrf24.o radioPinFunctions.o transport.o hop.o
 PORTN=$(shell type COMPORT.inc)
 
 SPI_nRF24L01.elf: $(OBJ)
@@ -19,6 +19,12 @@ nrf24.o: nrf24.c
 radioPinFunctions.o: radioPinFunctions.c
 	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o radioPinFunctions.o radioPinFunctions.c -DXPRJ_default=default -legacy-libc
 
+transport.o: transport.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o transport.o transport.c -DXPRJ_default=default -legacy-libc
+
+hop.o: hop.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o hop.o hop.c -DXPRJ_default=default -legacy-libc
+
 clean:
 	@del *.o *.elf *.hex *.map *.d 2>NUL
 	
@@ -0,0 +1,171 @@
+// Transport_Test.c:  Runs transport.c on a PC between two simulated radios.
+//
+// Two nodes send each other random messages (0 to TP_MAX_MSG bytes) over a
+// simulated link that loses packets, and check that every message arrives
+// once, complete and in order.  The link carries RADIO_PKTS_PER_MS packets
+// per millisecond from each node (about what streaming at 1Mbps gives) with
+// RADIO_DELAY_MS of delay, and loses each packet with the given probability,
+// like a packet the nRF24L01 gave up on after its own retransmits.
+//
+// Compile using gcc:
+// gcc Transport_Test.c transport.c -o Transport_Test
+//
+// Usage: Transport_Test [-L<loss %>] [-N<messages>] [-S<seed>]
+//   -L  Packet loss in percent, both directions (default 10)
+//   -N  Messages sent by each node (default 200)
+//   -S  Random seed (default 1)
+//
+// Exits with 1 if any message went missing, came twice or was damaged.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "transport.h"
+
+#define RADIO_PKTS_PER_MS 2
+#define RADIO_DELAY_MS    1
+#define RADIO_QUEUE       256
+#define MAX_MSGS          2000
+#define TIMEOUT_MS        600000L
+
+typedef struct {
+	unsigned long arrive;
+	uint8_t len;
+	uint8_t pkt[TP_PACKET];
+} AIR_PKT;
+
+typedef struct {
+	AIR_PKT q[RADIO_QUEUE];
+	int head, count;
+	int sent_this_ms;
+} AIR;
+
+TP node[2];
+AIR air[2]; // air[n] carries packets sent by node n
+unsigned long now;
+int loss_pct=10;
+unsigned long lost=0;
+
+// Messages each node sends, and how far the other one got receiving them
+uint8_t * msgs[2][MAX_MSGS];
+uint16_t msg_len[2][MAX_MSGS];
+int nmsgs=200, received[2], errors=0;
+
+unsigned long rnd_state=1;
+unsigned long rnd(void)
+{
+	rnd_state=rnd_state*1103515245UL+12345UL;
+	return (rnd_state>>16)&0x7fff;
+}
+
+int tp_radio_send(TP * tp, const uint8_t * pkt, uint8_t len)
+{
+	AIR * a=&air[tp->node];
+	AIR_PKT * p;
+
+	if(a->sent_this_ms>=RADIO_PKTS_PER_MS) return 0;
+	if(a->count>=RADIO_QUEUE) return 0;
+	a->sent_this_ms++;
+	if((int)(rnd()%100)<loss_pct)
+	{
+		lost++;
+		return 1; // Sent, but nobody heard it
+	}
+	p=&a->q[(a->head+a->count)%RADIO_QUEUE];
+	p->arrive=now+RADIO_DELAY_MS;
+	p->len=len;
+	memcpy(p->pkt, pkt, len);
+	a->count++;
+	return 1;
+}
+
+void tp_deliver(TP * tp, const uint8_t * msg, uint16_t len)
+{
+	int from=1-tp->node;
+	int k=received[tp->node];
+
+	if(k>=nmsgs)
+	{
+		printf("Node %d: message %d received, only %d were sent\n", tp->node, k, nmsgs);
+		errors++;
+		return;
+	}
+	if((len!=msg_len[from][k]) || (memcmp(msg, msgs[from][k], len)!=0))
+	{
+		printf("Node %d: message %d is wrong (%d bytes, expected %d)\n", tp->node, k, len, msg_len[from][k]);
+		errors++;
+	}
+	received[tp->node]++;
+}
+
+int main(int argc, char ** argv)
+{
+	int j, n, next[2]={0, 0};
+	unsigned long seed=1, bytes=0;
+	AIR_PKT * p;
+	TP_STATS * s;
+
+	for(j=1; j<argc; j++)
+	{
+		if(argv[j][0]=='-' && (argv[j][1]=='L' || argv[j][1]=='l')) loss_pct=atoi(&argv[j][2]);
+		else if(argv[j][0]=='-' && (argv[j][1]=='N' || argv[j][1]=='n')) nmsgs=atoi(&argv[j][2]);
+		else if(argv[j][0]=='-' && (argv[j][1]=='S' || argv[j][1]=='s')) seed=strtoul(&argv[j][2], NULL, 10);
+		else
+		{
+			printf("Usage: %s [-L<loss %%>] [-N<messages>] [-S<seed>]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(nmsgs>MAX_MSGS) nmsgs=MAX_MSGS;
+	rnd_state=seed;
+
+	for(n=0; n<2; n++)
+	{
+		tp_init(&node[n], n);
+		for(j=0; j<nmsgs; j++)
+		{
+			msg_len[n][j]=rnd()%(TP_MAX_MSG+1);
+			msgs[n][j]=malloc(msg_len[n][j]+1);
+			for(int k=0; k<msg_len[n][j]; k++) msgs[n][j][k]=rnd();
+			bytes+=msg_len[n][j];
+		}
+	}
+
+	for(now=0; now<TIMEOUT_MS; now++)
+	{
+		for(n=0; n<2; n++)
+		{
+			air[n].sent_this_ms=0;
+			// Deliver what arrived by now to the other node
+			while(air[n].count && (air[n].q[air[n].head].arrive<=now))
+			{
+				p=&air[n].q[air[n].head];
+				tp_input(&node[1-n], p->pkt, p->len, now);
+				air[n].head=(air[n].head+1)%RADIO_QUEUE;
+				air[n].count--;
+			}
+		}
+		for(n=0; n<2; n++)
+		{
+			while((next[n]<nmsgs) && tp_send(&node[n], msgs[n][next[n]], msg_len[n][next[n]])) next[n]++;
+			tp_poll(&node[n], now);
+		}
+		if((received[0]==nmsgs) && (received[1]==nmsgs) && tp_idle(&node[0]) && tp_idle(&node[1])) break;
+	}
+
+	printf("loss %d%%, %d messages each way, %lu bytes in %lu ms (%lu bytes/s)\n",
+	       loss_pct, nmsgs, bytes, now, now?(bytes*1000)/now:0);
+	for(n=0; n<2; n++)
+	{
+		s=&node[n].stats;
+		printf("node %d: sent %lu msgs %lu pkts (%lu resent), got %lu msgs, %lu dups, %lu out of order, "
+		       "acks %lu/%lu, rtt mean %.1f max %lu ms\n",
+		       n, s->msgs_sent, s->pkts_sent, s->retransmits, s->msgs_received, s->dups, s->out_of_order,
+		       s->acks_sent, s->acks_received, s->rtt_count?(double)s->rtt_sum/s->rtt_count:0.0, s->rtt_max);
+	}
+	printf("packets lost on the air: %lu\n", lost);
+
+	if((received[0]!=nmsgs) || (received[1]!=nmsgs)) errors++;
+	printf("%s\n", errors?"FAIL":"OK");
+	return errors?1:0;
+}
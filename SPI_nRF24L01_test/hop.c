@@ -0,0 +1,185 @@
+// hop.c:  Channel hopping for the nRF24L01 link.  See hop.h.
+
+#include <string.h>
+#include "nrf24.h"
+#include "hop.h"
+
+void hop_init(HOP * h, uint8_t master, uint8_t home)
+{
+	uint8_t j;
+
+	memset(h, 0, sizeof(HOP));
+	h->master=master;
+	h->home=home;
+	h->channel=home;
+	// Until hop_scan(): spread over the band
+	h->table[0]=home;
+	for(j=1; j<=HOP_CHANNELS; j++)
+	{
+		h->table[j]=HOP_FIRST+(j-1)*(HOP_LAST-HOP_FIRST)/HOP_CHANNELS;
+		if(h->table[j]==home) h->table[j]++;
+	}
+	h->next=1;
+	nrf24_setChannel(home);
+}
+
+// The quietest channels, at least HOP_SPACING away from the ones already in
+// the table.  Busy channels are skipped even when nothing else is left.
+void hop_scan(HOP * h)
+{
+	uint8_t k, ch, best, ok, n=1;
+
+	nrf24_scan(HOP_FIRST, HOP_LAST, HOP_SCAN_PASSES, h->hits);
+	while(n<=HOP_CHANNELS)
+	{
+		best=0;
+		for(ch=HOP_FIRST; ch<=HOP_LAST; ch++)
+		{
+			ok=1;
+			for(k=0; k<n; k++)
+			{
+				if((ch+HOP_SPACING>h->table[k]) && (ch<h->table[k]+HOP_SPACING)) ok=0;
+			}
+			if(ok && ((best==0) || (h->hits[ch-HOP_FIRST]<h->hits[best-HOP_FIRST]))) best=ch;
+		}
+		if((best==0) || (h->hits[best-HOP_FIRST]>HOP_SCAN_PASSES/2)) break;
+		h->table[n++]=best;
+	}
+	// If the band is that busy the old entries stay in the rest of the table
+	h->next=1;
+}
+
+static int send_once(uint8_t * pkt, uint8_t len, uint8_t * retries)
+{
+	uint8_t status;
+
+	nrf24_sendLen(pkt, len);
+	while(nrf24_isSending());
+	status=nrf24_lastMessageStatus();
+	*retries=nrf24_retransmissionCount();
+	nrf24_powerUpRx();
+	return status==NRF24_TRANSMISSON_OK;
+}
+
+static void set_channel(HOP * h, uint8_t ch, unsigned long now)
+{
+	nrf24_setChannel(ch);
+	h->channel=ch;
+	h->since=now;
+	h->sent=h->lost=h->fails=0;
+	h->retries=0;
+}
+
+// Tell the slave, then go.  If the acknowledge does not come back the slave
+// may have moved anyway: the next lost packets start a search.
+static void hop(HOP * h, unsigned long now)
+{
+	uint8_t pkt[3], retries, ch;
+
+	ch=h->table[h->next];
+	h->next=(h->next%HOP_CHANNELS)+1;
+	if(ch==h->channel)
+	{
+		ch=h->table[h->next];
+		h->next=(h->next%HOP_CHANNELS)+1;
+	}
+	pkt[0]=HOP_CMD;
+	pkt[1]=ch;
+	pkt[2]=~ch;
+	if(send_once(pkt, 3, &retries))
+	{
+		set_channel(h, ch, now);
+		h->stats.hops++;
+	}
+	else
+	{
+		h->stats.hop_fails++;
+	}
+}
+
+// Where did the slave go?  Try the packet on every channel of the table.
+// Nobody there: wait on the home channel, the slave goes back to it.
+static int search(HOP * h, uint8_t * pkt, uint8_t len, unsigned long now)
+{
+	uint8_t j, retries, from=h->channel;
+
+	h->stats.searches++;
+	for(j=0; j<=HOP_CHANNELS; j++)
+	{
+		if(h->table[j]==from) continue;
+		nrf24_setChannel(h->table[j]);
+		if(send_once(pkt, len, &retries))
+		{
+			set_channel(h, h->table[j], now);
+			h->stats.found++;
+			return 1;
+		}
+	}
+	set_channel(h, h->home, now);
+	return 0;
+}
+
+int hop_send(HOP * h, uint8_t * pkt, uint8_t len, unsigned long now)
+{
+	uint8_t retries;
+	int ok;
+
+	ok=send_once(pkt, len, &retries);
+	h->last_tx=now;
+	if(!h->master) return ok;
+
+	h->sent++;
+	h->retries+=retries;
+	if(ok) h->fails=0;
+	else
+	{
+		h->lost++;
+		if(++h->fails>=HOP_SEARCH_AFTER) return search(h, pkt, len, now);
+	}
+
+	if((h->lost>=HOP_MAX_LOST) || (h->retries>=HOP_MAX_RETRIES))
+	{
+		if((now-h->since)>=HOP_HOLD_MS) hop(h, now);
+	}
+	if(h->sent>=HOP_WINDOW)
+	{
+		h->sent=h->lost=0;
+		h->retries=0;
+	}
+	return ok;
+}
+
+int hop_input(HOP * h, uint8_t * pkt, uint8_t len, unsigned long now)
+{
+	h->last_rx=now;
+	if((len<3) || (pkt[0]!=HOP_CMD) || (pkt[2]!=(uint8_t)~pkt[1])) return 0;
+	if(!h->master && (pkt[1]!=h->channel))
+	{
+		set_channel(h, pkt[1], now);
+		h->stats.hops++;
+	}
+	return 1;
+}
+
+void hop_poll(HOP * h, unsigned long now)
+{
+	uint8_t pkt[3];
+
+	if(h->master)
+	{
+		if((now-h->last_tx)>=HOP_BEACON_MS)
+		{
+			pkt[0]=HOP_CMD;
+			pkt[1]=h->channel;
+			pkt[2]=~h->channel;
+			h->stats.beacons++;
+			hop_send(h, pkt, 3, now);
+		}
+	}
+	else if((h->channel!=h->home) && ((now-h->last_rx)>=HOP_LOST_MS))
+	{
+		set_channel(h, h->home, now);
+		h->last_rx=now;
+		h->stats.lost++;
+	}
+}
@@ -0,0 +1,71 @@
+// hop.h:  Channel hopping for the nRF24L01 link.
+//
+// The radio starts on a fixed 'home' channel.  When that channel gets busy
+// (WiFi, other radios) packets need many retransmits or get lost for good,
+// so the link moves to another channel:
+//
+//   - The master (the transmitter, RA3 high) scans all the channels with the
+//     nRF24L01 received power detector and keeps the HOP_CHANNELS quietest
+//     ones, at least HOP_SPACING apart, in its hop table.
+//   - Over every HOP_WINDOW packets it sends it adds up the retransmits and
+//     the lost packets.  Too many of either and it sends a HOP_CMD packet
+//     with the next channel in the table.  Once the slave acknowledged it,
+//     both change channel.
+//   - If the acknowledge of HOP_CMD was lost only the slave moved.  After
+//     HOP_SEARCH_AFTER lost packets in a row the master looks for the slave
+//     on the other channels of the table, home channel first.
+//   - When idle the master sends a HOP_CMD for the channel it is on every
+//     HOP_BEACON_MS.  A slave that hears nothing for HOP_LOST_MS goes back
+//     to the home channel, where the master looks first.
+//
+// Only the master measures and decides, so only it needs a hop table.
+
+#ifndef HOP_H
+#define HOP_H
+
+#include <stdint.h>
+
+#define HOP_CMD 0x03 // Packet type, next to TP_DATA and TP_ACK: HOP_CMD, channel, ~channel
+
+#define HOP_FIRST        2   // Channels scanned
+#define HOP_LAST         125
+#define HOP_SCAN_PASSES  20
+#define HOP_CHANNELS     6   // In the hop table, besides the home channel
+#define HOP_SPACING      3   // MHz between channels in the table
+#define HOP_WINDOW       16  // Packets the link quality is measured over
+#define HOP_MAX_LOST     2   // Hop if this many of them were lost...
+#define HOP_MAX_RETRIES  32  // ...or they needed this many retransmits
+#define HOP_HOLD_MS      500 // Stay at least this long on a channel
+#define HOP_SEARCH_AFTER 2   // Lost packets in a row before looking for the slave
+#define HOP_BEACON_MS    250
+#define HOP_LOST_MS      1000
+
+typedef struct {
+	unsigned long hops, hop_fails;   // Channel changes, and HOP_CMD not acknowledged
+	unsigned long searches, found;   // Looking for the slave, and finding it
+	unsigned long beacons, lost;     // Slave: back to the home channel
+} HOP_STATS;
+
+typedef struct {
+	uint8_t master;
+	uint8_t home, channel;
+	uint8_t table[HOP_CHANNELS+1]; // table[0] is the home channel
+	uint8_t next;                  // Table entry for the next hop
+
+	// Link quality over the current window
+	uint8_t sent, lost, fails;
+	uint16_t retries;
+
+	unsigned long since;           // When we got to this channel
+	unsigned long last_tx, last_rx;
+	uint8_t hits[HOP_LAST-HOP_FIRST+1]; // Last scan
+	HOP_STATS stats;
+} HOP;
+
+void hop_init(HOP * h, uint8_t master, uint8_t home);
+void hop_scan(HOP * h);  // Master: scan and fill the hop table
+int  hop_send(HOP * h, uint8_t * pkt, uint8_t len, unsigned long now); // 1 if acknowledged
+int  hop_input(HOP * h, uint8_t * pkt, uint8_t len, unsigned long now); // Every packet received, 1 if it was a HOP_CMD
+void hop_poll(HOP * h, unsigned long now);
+
+#endif
@@ -35,6 +35,7 @@
 #define STATUS      0x07
 #define OBSERVE_TX  0x08
 #define CD          0x09
+#define RPD         0x09 /* nRF24L01+ name of CD */
 #define RX_ADDR_P0  0x0A
 #define RX_ADDR_P1  0x0B
 #define RX_ADDR_P2  0x0C
@@ -50,6 +51,7 @@
 #define RX_PW_P5    0x16
 #define FIFO_STATUS 0x17
 #define DYNPD       0x1C
+#define FEATURE     0x1D
 
 /* Bit Mnemonics */
 
@@ -116,6 +118,11 @@
 #define DPL_P4      4
 #define DPL_P5      5
 
+/* feature register */
+#define EN_DPL      2
+#define EN_ACK_PAY  1
+#define EN_DYN_ACK  0
+
 /* Instruction Mnemonics */
 #define R_REGISTER    0x00 /* last 4 bits will indicate reg. address */
 #define W_REGISTER    0x20 /* last 4 bits will indicate reg. address */
@@ -127,4 +134,6 @@
 #define REUSE_TX_PL   0xE3
 #define ACTIVATE      0x50 
 #define R_RX_PL_WID   0x60
+#define W_ACK_PAYLOAD 0xA8 /* last 3 bits will indicate the pipe */
+#define W_TX_PAYLOAD_NOACK 0xB0
 #define NOP           0xFF
@@ -17,6 +17,57 @@
 uint8_t spi_transfer(uint8_t tx);
 
 uint8_t payload_len;
+static uint8_t pipe_len[6]; /* Static payload length of each pipe */
+static uint8_t pipes_on;    /* Pipes 1 to 5 receiving, bit n for pipe n */
+static uint8_t dynamic;  /* Dynamic payload length, see nrf24_dynamicPayloads() */
+static uint8_t rx_len;   /* Length of the last payload nrf24_getData() returned */
+static uint8_t rx_pipe;  /* Pipe it came from */
+
+/* Interrupt driven mode, see nrf24_irq() */
+static volatile uint8_t irq_mode;
+static volatile uint8_t irq_lock;
+static uint8_t rx_queue[NRF24_RX_QUEUE][32];
+static uint8_t rx_queue_len[NRF24_RX_QUEUE];
+static uint8_t rx_queue_pipe[NRF24_RX_QUEUE];
+static volatile uint8_t rx_head, rx_tail, rx_count;
+static volatile uint8_t tx_queue[NRF24_TX_QUEUE];
+static volatile uint8_t tx_head, tx_tail, tx_count;
+static volatile uint8_t tx_pending;
+static volatile uint16_t tx_lost;
+static volatile uint8_t last_status = 0xFF;
+volatile uint16_t nrf24_rxDropped;
+
+/* In interrupt mode every SPI transaction runs with the IRQ pin interrupt
+   off, so the interrupt never finds CSN already low.  Nests, since the
+   interrupt itself goes through here too. */
+static void irq_off()
+{
+    if(irq_mode)
+    {
+        nrf24_irq_enable(0);
+        irq_lock++;
+    }
+}
+
+static void irq_on()
+{
+    if(irq_mode)
+    {
+        if(--irq_lock==0) nrf24_irq_enable(1);
+    }
+}
+
+static void csn_low()
+{
+    irq_off();
+    nrf24_csn_digitalWrite(LOW);
+}
+
+static void csn_high()
+{
+    nrf24_csn_digitalWrite(HIGH);
+    irq_on();
+}
 
 /* init the hardware pins */
 void nrf24_init() 
@@ -31,6 +82,10 @@ void nrf24_config(uint8_t channel, uint8_t pay_length)
 {
     /* Use static payload length ... */
     payload_len = pay_length;
+    pipe_len[0] = 0;
+    pipe_len[1] = pay_length;
+    pipe_len[2] = pipe_len[3] = pipe_len[4] = pipe_len[5] = 0;
+    pipes_on = (1<<1);
 
     // Set RF channel
     nrf24_configRegister(RF_CH,channel);
@@ -73,6 +128,48 @@ void nrf24_rx_address(uint8_t * adr)
     nrf24_ce_digitalWrite(HIGH);
 }
 
+/* Receive on one more pipe, so a base station can hear up to six
+   transmitters at once: each one sends to the address of its own pipe.
+   Pipe 1 takes all nrf24_ADDR_LEN bytes of 'adr', like nrf24_rx_address().
+   Pipes 2 to 5 only have their own first byte (adr[0], the LSB) and share
+   the other bytes with pipe 1, so set pipe 1 first.  With dynamic payloads
+   'pay_length' is not used. */
+void nrf24_pipeConfig(uint8_t pipe, uint8_t* adr, uint8_t pay_length)
+{
+    if(pipe<1 || pipe>5) return;
+    if(pay_length>32) pay_length = 32;
+
+    nrf24_ce_digitalWrite(LOW);
+    if(pipe==1)
+        nrf24_writeRegister(RX_ADDR_P1,adr,nrf24_ADDR_LEN);
+    else
+        nrf24_configRegister(RX_ADDR_P0+pipe,adr[0]);
+    nrf24_configRegister(RX_PW_P0+pipe,pay_length);
+    pipe_len[pipe] = pay_length;
+    pipes_on |= (1<<pipe);
+
+    /* ENAA_Pn, ERX_Pn and DPL_Pn are all bit n */
+    nrf24_configRegister(EN_AA,(1<<ENAA_P0)|pipes_on);
+    nrf24_configRegister(EN_RXADDR,(1<<ERX_P0)|pipes_on);
+    if(dynamic) nrf24_configRegister(DYNPD,(1<<DPL_P0)|pipes_on);
+    nrf24_ce_digitalWrite(HIGH);
+}
+
+/* Stop receiving on pipe 2 to 5 */
+void nrf24_pipeClose(uint8_t pipe)
+{
+    if(pipe<2 || pipe>5) return;
+
+    nrf24_ce_digitalWrite(LOW);
+    pipes_on &= ~(1<<pipe);
+    pipe_len[pipe] = 0;
+    nrf24_configRegister(EN_AA,(1<<ENAA_P0)|pipes_on);
+    nrf24_configRegister(EN_RXADDR,(1<<ERX_P0)|pipes_on);
+    nrf24_configRegister(RX_PW_P0+pipe,0);
+    if(dynamic) nrf24_configRegister(DYNPD,(1<<DPL_P0)|pipes_on);
+    nrf24_ce_digitalWrite(HIGH);
+}
+
 /* Returns the payload length */
 uint8_t nrf24_payload_length()
 {
@@ -91,8 +188,13 @@ void nrf24_tx_address(uint8_t* adr)
 /* Returns 1 if data is ready ... */
 uint8_t nrf24_dataReady() 
 {
+    uint8_t status;
+
+    /* The interrupt already moved everything to the RX queue */
+    if(irq_mode) return rx_count!=0;
+
     // See note in getData() function - just checking RX_DR isn't good enough
-    uint8_t status = nrf24_getStatus();
+    status = nrf24_getStatus();
 
     // We can short circuit on RX_DR, but if it's not set, we still need
     // to check the FIFO for any pending packets
@@ -118,30 +220,180 @@ uint8_t nrf24_rxFifoEmpty()
 uint8_t nrf24_payloadLength()
 {
     uint8_t status;
-    nrf24_csn_digitalWrite(LOW);
+    csn_low();
     spi_transfer(R_RX_PL_WID);
     status = spi_transfer(0x00);
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
     return status;
 }
 
-/* Reads payload bytes into data array */
-void nrf24_getData(uint8_t* dta) 
+/* Pipe of the payload at the head of the RX fifo, 7 if it is empty */
+static uint8_t rx_pipe_no()
+{
+    return (nrf24_getStatus()>>RX_P_NO)&0x07;
+}
+
+/* Length of the payload at the head of the RX fifo.  With dynamic payloads a
+   width over 32 means a corrupt packet: the datasheet says flush it.  A
+   static payload on a pipe with no length set can not be read either. */
+static uint8_t rx_width(uint8_t pipe)
+{
+    uint8_t w;
+
+    if(pipe>5) return 0;
+    if(dynamic) w = nrf24_payloadLength();
+    else w = pipe_len[pipe];
+    if(w==0 || w>32)
+    {
+        csn_low();
+        spi_transfer(FLUSH_RX);
+        csn_high();
+        return 0;
+    }
+    return w;
+}
+
+/* Length of the last payload returned by nrf24_getData() */
+uint8_t nrf24_rxLength()
+{
+    return rx_len;
+}
+
+/* Dynamic payload length (DPL) and ACK payloads on every pipe in use.  Call after
+   nrf24_config() on both ends.  Each packet then takes only the air time of
+   the bytes given to nrf24_sendLen(), and the receiver can answer in the
+   auto acknowledge with nrf24_ackPayload(). */
+void nrf24_dynamicPayloads(uint8_t on)
+{
+    uint8_t feature, rv;
+
+    feature = on?((1<<EN_DPL)|(1<<EN_ACK_PAY)|(1<<EN_DYN_ACK)):0;
+    nrf24_configRegister(FEATURE,feature);
+    nrf24_readRegister(FEATURE,&rv,1);
+    if(rv!=feature)
+    {
+        /* The original nRF24L01 (not the +) needs ACTIVATE to unlock FEATURE */
+        csn_low();
+        spi_transfer(ACTIVATE);
+        spi_transfer(0x73);
+        csn_high();
+        nrf24_configRegister(FEATURE,feature);
+    }
+    nrf24_configRegister(DYNPD,on?((1<<DPL_P0)|pipes_on):0);
+    dynamic = on;
+}
+
+/* Load a payload to be sent back with the next auto acknowledge on 'pipe'.
+   Up to three can wait in the TX FIFO.  The transmitter gets it as a normal
+   received payload on pipe 0 together with TX_DS.  In polling mode read it
+   before nrf24_powerUpRx(), which flushes the RX FIFO. */
+void nrf24_ackPayload(uint8_t pipe, uint8_t* value, uint8_t len)
+{
+    if(len>32) len = 32;
+    csn_low();
+    spi_transfer(W_ACK_PAYLOAD|(pipe&0x07));
+    nrf24_transmitSync(value,len);
+    csn_high();
+}
+
+/* Reads payload bytes into data array.  Returns the pipe it came from, 1
+   to 5 (0 for an ACK payload on the transmitter).  In interrupt mode 0xFF
+   if the RX queue was empty, and nrf24_rxLength() is then 0. */
+uint8_t nrf24_getData(uint8_t* dta) 
 {
+    uint8_t i;
+
+    if(irq_mode)
+    {
+        irq_off();
+        rx_len = 0;
+        rx_pipe = 0xFF;
+        if(rx_count)
+        {
+            rx_len = rx_queue_len[rx_tail];
+            rx_pipe = rx_queue_pipe[rx_tail];
+            for(i=0;i<rx_len;i++) dta[i] = rx_queue[rx_tail][i];
+            rx_tail = (rx_tail+1)%NRF24_RX_QUEUE;
+            rx_count--;
+        }
+        irq_on();
+        return rx_pipe;
+    }
+
+    rx_pipe = rx_pipe_no();
+    rx_len = rx_width(rx_pipe);
+
     /* Pull down chip select */
-    nrf24_csn_digitalWrite(LOW);                               
+    csn_low();                               
 
     /* Send cmd to read rx payload */
     spi_transfer( R_RX_PAYLOAD );
     
     /* Read payload */
-    nrf24_transferSync(dta,dta,payload_len);
+    nrf24_transferSync(dta,dta,rx_len);
     
     /* Pull up chip select */
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
 
     /* Reset status register */
     nrf24_configRegister(STATUS,(1<<RX_DR));   
+
+    return rx_pipe;
+}
+
+/* Change the RF channel, 0 to 125 (2400+channel MHz).  Only while not
+   sending.  Also clears the lost packet count in OBSERVE_TX. */
+void nrf24_setChannel(uint8_t channel)
+{
+    if(channel>125) channel = 125;
+    nrf24_ce_digitalWrite(LOW);
+    nrf24_configRegister(RF_CH,channel);
+    nrf24_ce_digitalWrite(HIGH);
+}
+
+uint8_t nrf24_getChannel()
+{
+    uint8_t rv;
+    nrf24_readRegister(RF_CH,&rv,1);
+    return rv;
+}
+
+/* 1 if something over -64dBm is on the air on the current channel right now
+   (RPD, or CD on the original nRF24L01).  Only means something in RX mode,
+   NRF24_RPD_US after CE went high. */
+uint8_t nrf24_carrier()
+{
+    uint8_t rv;
+    nrf24_readRegister(RPD,&rv,1);
+    return rv & 0x01;
+}
+
+/* Look for busy channels: hits[ch-first] counts in how many of 'passes'
+   sweeps over channels 'first' to 'last' nrf24_carrier() was set.  Nothing
+   can be received while it runs.  Ends in RX mode on the channel it started
+   on. */
+void nrf24_scan(uint8_t first, uint8_t last, uint8_t passes, uint8_t* hits)
+{
+    uint8_t ch, pass, home;
+
+    if(last>125) last = 125;
+    if(first>last) return;
+    home = nrf24_getChannel();
+    for(ch=first;ch<=last;ch++) hits[ch-first] = 0;
+
+    nrf24_powerUpRx();
+    for(pass=0;pass<passes;pass++)
+    {
+        for(ch=first;ch<=last;ch++)
+        {
+            nrf24_setChannel(ch);
+            nrf24_delay_us(NRF24_RPD_US);
+            if(nrf24_carrier()) hits[ch-first]++;
+        }
+    }
+    nrf24_ce_digitalWrite(LOW);
+    nrf24_configRegister(RF_CH,home);
+    nrf24_powerUpRx();
 }
 
 /* Returns the number of retransmissions occured for the last message */
@@ -156,7 +408,17 @@ uint8_t nrf24_retransmissionCount()
 // Sends a data package to the default address. Be sure to send the correct
 // amount of bytes as configured as payload on the receiver.
 void nrf24_send(uint8_t* value) 
-{    
+{
+    nrf24_sendLen(value,payload_len);
+}
+
+// Same, with the length of this packet.  Without dynamic payloads the length
+// is always the configured payload length.
+void nrf24_sendLen(uint8_t* value, uint8_t len)
+{
+    if(!dynamic) len = payload_len;
+    if(len>32) len = 32;
+
     /* Go to Standby-I first */
     nrf24_ce_digitalWrite(LOW);
      
@@ -166,26 +428,33 @@ void nrf24_send(uint8_t* value)
     /* Do we really need to flush TX fifo each time ? */
     #if 1
         /* Pull down chip select */
-        nrf24_csn_digitalWrite(LOW);           
+        csn_low();           
 
         /* Write cmd to flush transmit FIFO */
         spi_transfer(FLUSH_TX);     
 
         /* Pull up chip select */
-        nrf24_csn_digitalWrite(HIGH);                    
+        csn_high();                    
     #endif 
 
     /* Pull down chip select */
-    nrf24_csn_digitalWrite(LOW);
+    csn_low();
 
     /* Write cmd to write payload */
     spi_transfer(W_TX_PAYLOAD);
 
     /* Write payload */
-    nrf24_transmitSync(value,payload_len);   
+    nrf24_transmitSync(value,len);   
 
     /* Pull up chip select */
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
+
+    /* The flush dropped anything still waiting, so this is the only
+       packet the interrupt will report on */
+    irq_off();
+    tx_pending = 1;
+    last_status = 0xFF;
+    irq_on();
 
     /* Start the transmission */
     nrf24_ce_digitalWrite(HIGH);    
@@ -195,6 +464,9 @@ uint8_t nrf24_isSending()
 {
     uint8_t status;
 
+    /* The interrupt clears TX_DS and MAX_RT as soon as they show up */
+    if(irq_mode) return tx_pending!=0;
+
     /* read the current status */
     status = nrf24_getStatus();
     //printf("nrf24_getStatus()=0x%02x\r\n", status);
@@ -212,9 +484,9 @@ uint8_t nrf24_isSending()
 uint8_t nrf24_getStatus()
 {
     uint8_t rv;
-    nrf24_csn_digitalWrite(LOW);
+    csn_low();
     rv = spi_transfer(NOP);
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
     return rv;
 }
 
@@ -222,6 +494,8 @@ uint8_t nrf24_lastMessageStatus()
 {
     uint8_t rv;
 
+    if(irq_mode) return last_status;
+
     rv = nrf24_getStatus();
 
     /* Transmission went OK */
@@ -242,11 +516,307 @@ uint8_t nrf24_lastMessageStatus()
     }
 }
 
+/* Queue a TX_DS or MAX_RT result, from the interrupt */
+static void tx_done(uint8_t result)
+{
+    last_status = result;
+    if(result==NRF24_MESSAGE_LOST) tx_lost++;
+    if(tx_pending) tx_pending--;
+    if(tx_count<NRF24_TX_QUEUE)
+    {
+        tx_queue[tx_head] = result;
+        tx_head = (tx_head+1)%NRF24_TX_QUEUE;
+        tx_count++;
+    }
+}
+
+/* Move one payload from the RX FIFO to the RX queue, from the interrupt.  If
+   the queue is full the payload is read anyway and dropped, or the IRQ pin
+   would stay low for good. */
+static void rx_read()
+{
+    uint8_t dummy[32];
+    uint8_t* dta = dummy;
+    uint8_t len, pipe;
+
+    pipe = rx_pipe_no();
+    len = rx_width(pipe);
+    if(len==0) return;
+
+    if(rx_count<NRF24_RX_QUEUE)
+    {
+        dta = rx_queue[rx_head];
+        rx_queue_len[rx_head] = len;
+        rx_queue_pipe[rx_head] = pipe;
+    }
+    else
+    {
+        nrf24_rxDropped++;
+    }
+
+    csn_low();
+    spi_transfer(R_RX_PAYLOAD);
+    nrf24_transferSync(dta,dta,len);
+    csn_high();
+
+    if(dta!=dummy)
+    {
+        rx_head = (rx_head+1)%NRF24_RX_QUEUE;
+        rx_count++;
+    }
+}
+
+/* Everything in the RX FIFO to the RX queue.  In interrupt mode, before
+   clearing RX_DR or flushing the RX FIFO by hand: a payload left behind with
+   RX_DR cleared never pulls the IRQ pin low again. */
+static void rx_drain()
+{
+    uint8_t fifo;
+
+    irq_off();
+    nrf24_readRegister(FIFO_STATUS,&fifo,1);
+    while(!(fifo & (1<<RX_EMPTY)))
+    {
+        rx_read();
+        nrf24_readRegister(FIFO_STATUS,&fifo,1);
+    }
+    irq_on();
+}
+
+/* How many packets are in the TX FIFO.  Only while MAX_RT is set: the radio
+   sends nothing then, so with one or two left a dummy payload tells them
+   apart (it fills the FIFO if there were two).  Flush after this. */
+static uint8_t tx_fifo_count()
+{
+    uint8_t fifo, i;
+
+    nrf24_readRegister(FIFO_STATUS,&fifo,1);
+    if(fifo & (1<<TX_EMPTY)) return 0;
+    if(fifo & (1<<FIFO_FULL)) return 3;
+
+    csn_low();
+    spi_transfer(W_TX_PAYLOAD);
+    for(i=0; i<(dynamic?1:payload_len); i++) spi_transfer(0x00);
+    csn_high();
+
+    nrf24_readRegister(FIFO_STATUS,&fifo,1);
+    return (fifo & (1<<FIFO_FULL))?2:1;
+}
+
+/* Call from the IRQ pin interrupt (falling edge).  Reads STATUS once, clears
+   the flags that were set and turns them into queue entries, so nobody has
+   to poll the radio.  The IRQ pin stays low while any flag is set, so call
+   it again for as long as the pin reads low. */
+void nrf24_irq()
+{
+    uint8_t status, fifo;
+
+    status = nrf24_getStatus();
+
+    /* TX_DS can stand for more than one packet when streaming.  If the TX
+       FIFO is empty they all made it, otherwise count one and catch up on a
+       later TX_DS (or on MAX_RT, below). */
+    if((status & (1<<TX_DS)) && !(status & (1<<MAX_RT)))
+    {
+        nrf24_readRegister(FIFO_STATUS,&fifo,1);
+        if(fifo & (1<<TX_EMPTY))
+        {
+            while(tx_pending>1) tx_done(NRF24_TRANSMISSON_OK);
+        }
+        tx_done(NRF24_TRANSMISSON_OK);
+    }
+
+    /* With CE high clearing MAX_RT would send the same packet all over
+       again.  Drop it, with whatever was queued behind it: those are lost.
+       Anything pending that already left the FIFO made it, TX_DS or not. */
+    if(status & (1<<MAX_RT))
+    {
+        fifo = tx_fifo_count();
+        csn_low();
+        spi_transfer(FLUSH_TX);
+        csn_high();
+        while(tx_pending>fifo) tx_done(NRF24_TRANSMISSON_OK);
+        while(tx_pending) tx_done(NRF24_MESSAGE_LOST);
+    }
+
+    nrf24_configRegister(STATUS,status&((1<<RX_DR)|(1<<TX_DS)|(1<<MAX_RT)));
+
+    if(status & (1<<RX_DR)) rx_drain();
+}
+
+/* Streaming: the radio stays in TX mode with CE high, and sends whatever is
+   in its 3 deep TX FIFO back to back.  No FLUSH_TX, no power cycling and no
+   130us PLL settling between packets, just once at each end of the burst.
+
+     nrf24_streamBegin();
+     for(...) while(!nrf24_streamWrite(buf,len,0));
+     lost=nrf24_streamEnd();
+
+   Lost packets are counted exactly in interrupt driven mode.  When polling,
+   a MAX_RT flushes whatever was in the FIFO and counts as one. */
+
+void nrf24_streamBegin()
+{
+    nrf24_ce_digitalWrite(LOW);
+    nrf24_powerUpTx();
+
+    csn_low();
+    spi_transfer(FLUSH_TX);
+    csn_high();
+
+    irq_off();
+    tx_pending = 0;
+    tx_lost = 0;
+    last_status = 0xFF;
+    irq_on();
+
+    nrf24_ce_digitalWrite(HIGH);
+}
+
+/* Queue one packet.  Returns 0 without sending if the TX FIFO is full, try
+   again later.  'noack' sends it without asking for an acknowledge (needs
+   nrf24_dynamicPayloads(1)): faster, but nobody knows if it arrived. */
+uint8_t nrf24_streamWrite(uint8_t* value, uint8_t len, uint8_t noack)
+{
+    uint8_t status;
+
+    if(!dynamic) len = payload_len;
+    if(len>32) len = 32;
+
+    if(irq_mode)
+    {
+        if(tx_pending>=3) return 0;
+    }
+    else
+    {
+        status = nrf24_getStatus();
+        if(status & (1<<MAX_RT))
+        {
+            csn_low();
+            spi_transfer(FLUSH_TX);
+            csn_high();
+            tx_lost++;
+        }
+        nrf24_configRegister(STATUS,status&((1<<TX_DS)|(1<<MAX_RT)));
+        if((status & (1<<TX_FULL)) && !(status & (1<<MAX_RT))) return 0;
+    }
+
+    irq_off();
+    csn_low();
+    spi_transfer(noack?W_TX_PAYLOAD_NOACK:W_TX_PAYLOAD);
+    nrf24_transmitSync(value,len);
+    csn_high();
+    tx_pending++;
+    irq_on();
+    return 1;
+}
+
+/* Wait for the FIFO to empty, then go back to RX.  Returns the number of
+   packets lost during the burst.  A missed IRQ or a radio that does not
+   answer would keep it waiting for good, so after NRF24_STREAM_TIMEOUT_US
+   whatever is left is flushed and counted as lost (as one packet when
+   polling, which can not tell how many there were). */
+uint16_t nrf24_streamEnd()
+{
+    uint8_t status, fifo;
+    uint32_t waited = 0;
+
+    if(irq_mode)
+    {
+        while(tx_pending && (waited<NRF24_STREAM_TIMEOUT_US))
+        {
+            nrf24_delay_us(10);
+            waited += 10;
+        }
+        if(tx_pending)
+        {
+            nrf24_ce_digitalWrite(LOW);
+            irq_off();
+            csn_low();
+            spi_transfer(FLUSH_TX);
+            csn_high();
+            tx_lost += tx_pending;
+            tx_pending = 0;
+            last_status = NRF24_MESSAGE_LOST;
+            irq_on();
+        }
+
+        /* The burst is summed up by the return value, not one by one */
+        while(nrf24_txEvent()!=0xFF);
+    }
+    else
+    {
+        while(1)
+        {
+            status = nrf24_getStatus();
+            if(status & (1<<MAX_RT))
+            {
+                csn_low();
+                spi_transfer(FLUSH_TX);
+                csn_high();
+                tx_lost++;
+            }
+            nrf24_configRegister(STATUS,status&((1<<TX_DS)|(1<<MAX_RT)));
+            nrf24_readRegister(FIFO_STATUS,&fifo,1);
+            if(fifo & (1<<TX_EMPTY)) break;
+            if(waited>=NRF24_STREAM_TIMEOUT_US)
+            {
+                nrf24_ce_digitalWrite(LOW);
+                csn_low();
+                spi_transfer(FLUSH_TX);
+                csn_high();
+                tx_lost++;
+                break;
+            }
+            nrf24_delay_us(10);
+            waited += 10;
+        }
+    }
+
+    nrf24_powerUpRx();
+    return tx_lost;
+}
+
+/* Switch between polling STATUS and the interrupt driven mode.  In the
+   interrupt driven mode nrf24_dataReady(), nrf24_getData(), nrf24_isSending()
+   and nrf24_lastMessageStatus() work from the queues, without SPI traffic. */
+void nrf24_useIrq(uint8_t on)
+{
+    nrf24_irq_enable(0);
+    irq_mode = 0;
+    irq_lock = 0;
+    rx_head = rx_tail = rx_count = 0;
+    tx_head = tx_tail = tx_count = 0;
+    tx_pending = 0;
+    last_status = 0xFF;
+    irq_mode = on;
+    if(on) nrf24_irq_enable(1);
+}
+
+/* Oldest TX result not read yet: NRF24_TRANSMISSON_OK, NRF24_MESSAGE_LOST or
+   0xFF if there is none */
+uint8_t nrf24_txEvent()
+{
+    uint8_t rv = 0xFF;
+
+    irq_off();
+    if(tx_count)
+    {
+        rv = tx_queue[tx_tail];
+        tx_tail = (tx_tail+1)%NRF24_TX_QUEUE;
+        tx_count--;
+    }
+    irq_on();
+    return rv;
+}
+
 void nrf24_powerUpRx()
 {     
-    nrf24_csn_digitalWrite(LOW);
+    if(irq_mode) rx_drain(); /* ACK payloads the interrupt has not read yet */
+
+    csn_low();
     spi_transfer(FLUSH_RX);
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
 
     nrf24_configRegister(STATUS,(1<<RX_DR)|(1<<TX_DS)|(1<<MAX_RT)); 
 
@@ -257,6 +827,8 @@ void nrf24_powerUpRx()
 
 void nrf24_powerUpTx()
 {
+    if(irq_mode) rx_drain();
+
     nrf24_configRegister(STATUS,(1<<RX_DR)|(1<<TX_DS)|(1<<MAX_RT)); 
 
     nrf24_configRegister(CONFIG,nrf24_CONFIG|((1<<PWR_UP)|(0<<PRIM_RX)));
@@ -306,49 +878,41 @@ uint8_t spi_transfer_soft(uint8_t tx)
 /* send and receive multiple bytes over SPI */
 void nrf24_transferSync(uint8_t* dataout,uint8_t* datain,uint8_t len)
 {
-    uint8_t i;
-
-    for(i=0;i<len;i++)
-    {
-        datain[i] = spi_transfer(dataout[i]);
-    }
-
+    spi_burst(dataout,datain,len);
 }
 
 /* send multiple bytes over SPI */
 void nrf24_transmitSync(uint8_t* dataout,uint8_t len)
 {
-    uint8_t i;
-    
-    for(i=0;i<len;i++)
-    {
-        spi_transfer(dataout[i]);
-    }
+    spi_burst(dataout,0,len);
 }
 
 /* Clocks only one byte into the given nrf24 register */
 void nrf24_configRegister(uint8_t reg, uint8_t value)
 {
-    nrf24_csn_digitalWrite(LOW);
-    spi_transfer(W_REGISTER | (REGISTER_MASK & reg));
-    spi_transfer(value);
-    nrf24_csn_digitalWrite(HIGH);
+    uint8_t buf[2];
+
+    buf[0] = W_REGISTER | (REGISTER_MASK & reg);
+    buf[1] = value;
+    csn_low();
+    spi_burst(buf,0,2);
+    csn_high();
 }
 
 /* Read single register from nrf24 */
 void nrf24_readRegister(uint8_t reg, uint8_t* value, uint8_t len)
 {
-    nrf24_csn_digitalWrite(LOW);
+    csn_low();
     spi_transfer(R_REGISTER | (REGISTER_MASK & reg));
     nrf24_transferSync(value,value,len);
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
 }
 
 /* Write to a single register of nrf24 */
 void nrf24_writeRegister(uint8_t reg, uint8_t* value, uint8_t len) 
 {
-    nrf24_csn_digitalWrite(LOW);
+    csn_low();
     spi_transfer(W_REGISTER | (REGISTER_MASK & reg));
     nrf24_transmitSync(value,len);
-    nrf24_csn_digitalWrite(HIGH);
+    csn_high();
 }
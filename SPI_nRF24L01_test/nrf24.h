@@ -26,11 +26,24 @@
 #define NRF24_TRANSMISSON_OK 0
 #define NRF24_MESSAGE_LOST   1
 
+/* RX settling time before RPD is valid, 130us + 40us */
+#define NRF24_RPD_US 170
+
+/* Longest nrf24_streamEnd() waits for the TX FIFO to empty: 3 packets of
+   15 retransmits 1000us apart, with some margin */
+#define NRF24_STREAM_TIMEOUT_US 100000UL
+
+/* Queue sizes for the interrupt driven mode */
+#define NRF24_RX_QUEUE 4 /* Payloads */
+#define NRF24_TX_QUEUE 4 /* TX results */
+
 /* adjustment functions */
 void    nrf24_init();
 void    nrf24_rx_address(uint8_t* adr);
 void    nrf24_tx_address(uint8_t* adr);
 void    nrf24_config(uint8_t channel, uint8_t pay_length);
+void    nrf24_pipeConfig(uint8_t pipe, uint8_t* adr, uint8_t pay_length); /* pipes 1 to 5 */
+void    nrf24_pipeClose(uint8_t pipe);
 
 /* state check functions */
 uint8_t nrf24_dataReady();
@@ -40,18 +53,39 @@ uint8_t nrf24_rxFifoEmpty();
 
 /* core TX / RX functions */
 void    nrf24_send(uint8_t* value);
-void    nrf24_getData(uint8_t* dta);
+void    nrf24_sendLen(uint8_t* value, uint8_t len);
+uint8_t nrf24_getData(uint8_t* dta); /* returns the pipe number, 0xFF if nothing was queued */
+uint8_t nrf24_rxLength(); /* length of the payload nrf24_getData() returned */
 
 /* use in dynamic length mode */
+void    nrf24_dynamicPayloads(uint8_t on);
+void    nrf24_ackPayload(uint8_t pipe, uint8_t* value, uint8_t len);
 uint8_t nrf24_payloadLength();
 
 /* post transmission analysis */
 uint8_t nrf24_lastMessageStatus();
 uint8_t nrf24_retransmissionCount();
 
+/* channel selection */
+void    nrf24_setChannel(uint8_t channel);
+uint8_t nrf24_getChannel();
+uint8_t nrf24_carrier(); /* received power detector, in RX mode */
+void    nrf24_scan(uint8_t first, uint8_t last, uint8_t passes, uint8_t* hits);
+
+/* interrupt driven mode, the IRQ pin instead of polling STATUS */
+void    nrf24_useIrq(uint8_t on);
+void    nrf24_irq();     /* call from the IRQ pin interrupt */
+uint8_t nrf24_txEvent(); /* oldest TX result, 0xFF if none */
+extern volatile uint16_t nrf24_rxDropped; /* payloads lost to a full RX queue */
+
 /* Returns the payload length */
 uint8_t nrf24_payload_length();
 
+/* streaming, several packets per trip to TX mode */
+void    nrf24_streamBegin();
+uint8_t nrf24_streamWrite(uint8_t* value, uint8_t len, uint8_t noack); /* 0 if the FIFO is full */
+uint16_t nrf24_streamEnd(); /* back to RX, returns the packets lost */
+
 /* power management */
 void    nrf24_powerUpRx();
 void    nrf24_powerUpTx();
@@ -59,6 +93,7 @@ void    nrf24_powerDown();
 
 /* low level interface ... */
 uint8_t spi_transfer(uint8_t tx);
+void    spi_burst(uint8_t* out, uint8_t* in, uint8_t len); /* out or in can be 0 */
 void    nrf24_transmitSync(uint8_t* dataout,uint8_t len);
 void    nrf24_transferSync(uint8_t* dataout,uint8_t* datain,uint8_t len);
 void    nrf24_configRegister(uint8_t reg, uint8_t value);
@@ -113,4 +148,19 @@ extern void nrf24_mosi_digitalWrite(uint8_t state);
 /* -------------------------------------------------------------------------- */
 extern uint8_t nrf24_miso_digitalRead();
 
+/* -------------------------------------------------------------------------- */
+/* nrf24 IRQ pin interrupt control function.  The interrupt must trigger on
+ * the falling edge of IRQ and call nrf24_irq() until the pin reads high.
+ *    - state:1 => Interrupt enabled
+ *    - state:0 => Interrupt disabled     */
+/* -------------------------------------------------------------------------- */
+extern void nrf24_irq_enable(uint8_t state);
+
+/* -------------------------------------------------------------------------- */
+/* Busy wait, used by nrf24_scan() to let the receiver settle and by
+ * nrf24_streamEnd() to time out
+ *    - us: microseconds     */
+/* -------------------------------------------------------------------------- */
+extern void nrf24_delay_us(uint16_t us);
+
 #endif
@@ -10,13 +10,56 @@
 */
 
 #include <XC.h>
+#include <sys/attribs.h>
 #include <stdint.h>
+#include "nrf24.h"
 
 /* ------------------------------------------------------------------------- */
 void nrf24_setupPins()
 {
-	// The pins are configured in file SPI_nRF24L01.c, in the function config_SPI
+	// The SPI pins are configured in file SPI_nRF24L01.c, in the function config_SPI
 
+	// IRQ is connected to RB7 (pin 16), which is also INT0.  The nRF24L01
+	// pulls it low when an event happens.
+	TRISBbits.TRISB7 = 1;
+	CNPUB |= (1<<7); // Reads high if the radio is not connected
+	IEC0bits.INT0IE = 0;
+	INTCONbits.INT0EP = 0; // Falling edge
+	IPC0bits.INT0IP = 3;
+	IPC0bits.INT0IS = 0;
+	IFS0bits.INT0IF = 0;
+	INTCONbits.MVEC = 1;
+}
+/* ------------------------------------------------------------------------- */
+void nrf24_irq_enable(uint8_t state)
+{
+	if(state)
+	{
+		IEC0SET=_IEC0_INT0IE_MASK; // An edge while disabled still sets INT0IF
+	}
+	else
+	{
+		IEC0CLR=_IEC0_INT0IE_MASK;
+	}
+}
+/* ------------------------------------------------------------------------- */
+// IRQ stays low while any flag is set, so a new event while nrf24_irq() runs
+// gives no new edge: keep going until the pin is high.
+void __ISR(_EXTERNAL_0_VECTOR, IPL3SOFT) INT0_Handler(void)
+{
+	IFS0CLR=_IFS0_INT0IF_MASK;
+	do
+	{
+		nrf24_irq();
+	} while(PORTBbits.RB7==0);
+}
+/* ------------------------------------------------------------------------- */
+// The core timer runs at SYSCLK/2, 20MHz
+void nrf24_delay_us(uint16_t us)
+{
+	unsigned long start=_CP0_GET_COUNT();
+
+	while((_CP0_GET_COUNT()-start)<(us*20UL));
 }
 /* ------------------------------------------------------------------------- */
 void nrf24_ce_digitalWrite(uint8_t state)
@@ -0,0 +1,242 @@
+// transport.c:  Reliable messages over the nRF24L01.  See transport.h.
+
+#include <string.h>
+#include "transport.h"
+
+#define SLOT(seq) ((seq)&(TP_TXQ-1))
+
+void tp_init(TP * tp, int node)
+{
+	memset(tp, 0, sizeof(TP));
+	tp->node=node;
+}
+
+int tp_idle(TP * tp)
+{
+	return tp->tx_base==tp->tx_next;
+}
+
+// Queue all the fragments of a message, or nothing if they do not all fit
+int tp_send(TP * tp, const uint8_t * msg, uint16_t len)
+{
+	uint16_t frags, j, n;
+	uint8_t used;
+	TP_SLOT * s;
+
+	if(len>TP_MAX_MSG) return 0;
+	frags=(len+TP_FRAG_DATA-1)/TP_FRAG_DATA;
+	if(frags==0) frags=1; // An empty message is still a message
+	used=tp->tx_next-tp->tx_base;
+	if(used+frags>TP_TXQ) return 0;
+
+	for(j=0; j<frags; j++)
+	{
+		n=len-j*TP_FRAG_DATA;
+		if(n>TP_FRAG_DATA) n=TP_FRAG_DATA;
+		s=&tp->tx[SLOT(tp->tx_next)];
+		s->pkt[0]=TP_DATA;
+		s->pkt[1]=tp->tx_next;
+		s->pkt[2]=tp->msg_next;
+		s->pkt[3]=j|((j==frags-1)?TP_LAST_FRAG:0);
+		if(n) memcpy(&s->pkt[TP_HEADER], &msg[j*TP_FRAG_DATA], n);
+		s->len=TP_HEADER+n;
+		s->sent=0;
+		s->acked=0;
+		tp->tx_next++;
+	}
+	tp->msg_next++;
+	tp->stats.msgs_sent++;
+	return 1;
+}
+
+void tp_poll(TP * tp, unsigned long now)
+{
+	uint8_t seq, end;
+	TP_SLOT * s;
+
+	end=tp->tx_base+TP_WINDOW;
+	if((uint8_t)(tp->tx_next-tp->tx_base)<TP_WINDOW) end=tp->tx_next;
+
+	for(seq=tp->tx_base; seq!=end; seq++)
+	{
+		s=&tp->tx[SLOT(seq)];
+		if(s->acked) continue;
+		if(s->sent && ((now-s->last)<TP_RTO)) continue;
+		if(!tp_radio_send(tp, s->pkt, s->len)) return; // Radio busy, later
+		if(s->sent==0) s->first=now;
+		else tp->stats.retransmits++;
+		if(s->sent<255) s->sent++;
+		s->last=now;
+		tp->stats.pkts_sent++;
+	}
+}
+
+static void send_ack(TP * tp)
+{
+	uint8_t pkt[3], j;
+
+	pkt[0]=TP_ACK;
+	pkt[1]=tp->rx_next;
+	pkt[2]=0;
+	for(j=0; j<TP_WINDOW; j++)
+	{
+		if(tp->rx_have[j]) pkt[2]|=1<<j;
+	}
+	// A lost acknowledge is covered by the next one, or by the sender
+	// sending the packet again and getting acknowledged again
+	if(tp_radio_send(tp, pkt, 3)) tp->stats.acks_sent++;
+}
+
+static void ack_one(TP * tp, uint8_t seq, unsigned long now)
+{
+	TP_SLOT * s=&tp->tx[SLOT(seq)];
+	unsigned long rtt;
+
+	if(s->acked || (s->sent==0)) return;
+	s->acked=1;
+	// Only packets sent once give a round trip time that means something
+	if(s->sent==1)
+	{
+		rtt=now-s->first;
+		tp->stats.rtt_sum+=rtt;
+		tp->stats.rtt_count++;
+		if(rtt>tp->stats.rtt_max) tp->stats.rtt_max=rtt;
+		tp->srtt=(tp->srtt*7+rtt*8+4)/8; // 1/8 of the way, 3 fractional bits
+	}
+}
+
+static void got_ack(TP * tp, const uint8_t * pkt, uint8_t len, unsigned long now)
+{
+	uint8_t cum, seq, j;
+	TP_SLOT * s;
+
+	if(len<3) return;
+	tp->stats.acks_received++;
+	cum=pkt[1];
+
+	// Ignore anything acknowledging packets never sent (an old acknowledge)
+	if((uint8_t)(cum-tp->tx_base)>(uint8_t)(tp->tx_next-tp->tx_base)) return;
+
+	for(seq=tp->tx_base; seq!=cum; seq++) ack_one(tp, seq, now);
+	for(j=0; j<TP_WINDOW; j++)
+	{
+		seq=cum+1+j;
+		if((pkt[2]&(1<<j)) && ((uint8_t)(seq-tp->tx_base)<(uint8_t)(tp->tx_next-tp->tx_base)))
+		{
+			ack_one(tp, seq, now);
+		}
+	}
+	while((tp->tx_base!=tp->tx_next) && tp->tx[SLOT(tp->tx_base)].acked) tp->tx_base++;
+
+	// Packets after 'cum' arrived but 'cum' did not: it was lost, no need to
+	// wait for TP_RTO.  Resend it once it has been out for a round trip, so
+	// the acknowledges of the packets sent after it do not resend it again.
+	if(pkt[2] && (tp->tx_base!=tp->tx_next))
+	{
+		s=&tp->tx[SLOT(cum)];
+		if(!s->acked && s->sent && ((now-s->last)*8>tp->srtt)) s->last=now-TP_RTO;
+	}
+}
+
+// Put the fragments back together, in order
+static void reassemble(TP * tp, const uint8_t * pkt, uint8_t len)
+{
+	uint8_t frag=pkt[3]&~TP_LAST_FRAG;
+	uint8_t n=len-TP_HEADER;
+
+	if(frag==0)
+	{
+		tp->msg_len=0;
+		tp->msg_id=pkt[2];
+		tp->frag_next=0;
+		tp->msg_bad=0;
+	}
+	if((frag!=tp->frag_next) || (pkt[2]!=tp->msg_id) || (tp->msg_len+n>TP_MAX_MSG))
+	{
+		tp->msg_bad=1; // Can only happen if the other end restarted
+	}
+	if(!tp->msg_bad)
+	{
+		memcpy(&tp->msg[tp->msg_len], &pkt[TP_HEADER], n);
+		tp->msg_len+=n;
+		tp->frag_next++;
+	}
+	if(pkt[3]&TP_LAST_FRAG)
+	{
+		if(!tp->msg_bad)
+		{
+			tp->stats.msgs_received++;
+			tp->stats.bytes_delivered+=tp->msg_len;
+			tp_deliver(tp, tp->msg, tp->msg_len);
+		}
+		tp->msg_len=0;
+		tp->frag_next=0;
+		tp->msg_bad=1; // Until the next first fragment
+	}
+}
+
+// rx_next moved up by one: slide the packets that came early down by one.
+// Returns 1 with the packet that is next in line now, if it is here.
+static int rx_slide(TP * tp, uint8_t * pkt, uint8_t * len)
+{
+	int have=tp->rx_have[0];
+	uint8_t j;
+
+	if(have)
+	{
+		*len=tp->rx_len[0];
+		memcpy(pkt, tp->rx_pkt[0], TP_PACKET);
+	}
+	for(j=0; j<TP_WINDOW-1; j++)
+	{
+		tp->rx_have[j]=tp->rx_have[j+1];
+		tp->rx_len[j]=tp->rx_len[j+1];
+		memcpy(tp->rx_pkt[j], tp->rx_pkt[j+1], TP_PACKET);
+	}
+	tp->rx_have[TP_WINDOW-1]=0;
+	return have;
+}
+
+static void got_data(TP * tp, const uint8_t * pkt, uint8_t len)
+{
+	uint8_t seq=pkt[1], ahead, j;
+	uint8_t next[TP_PACKET], next_len;
+
+	ahead=seq-tp->rx_next;
+	if(ahead==0)
+	{
+		reassemble(tp, pkt, len);
+		tp->rx_next++;
+		// Anything that came early and is next in line now
+		while(rx_slide(tp, next, &next_len))
+		{
+			reassemble(tp, next, next_len);
+			tp->rx_next++;
+		}
+	}
+	else if(ahead<=TP_WINDOW)
+	{
+		// A packet before this one was lost, keep this one for later
+		j=ahead-1;
+		if(tp->rx_have[j]) tp->stats.dups++;
+		else
+		{
+			tp->rx_have[j]=1;
+			tp->rx_len[j]=len;
+			memcpy(tp->rx_pkt[j], pkt, len);
+			tp->stats.out_of_order++;
+		}
+	}
+	else
+	{
+		tp->stats.dups++; // Already delivered, our acknowledge was lost
+	}
+	send_ack(tp);
+}
+
+void tp_input(TP * tp, const uint8_t * pkt, uint8_t len, unsigned long now)
+{
+	if(len<1) return;
+	if((pkt[0]==TP_DATA) && (len>=TP_HEADER) && (len<=TP_PACKET)) got_data(tp, pkt, len);
+	else if(pkt[0]==TP_ACK) got_ack(tp, pkt, len, now);
+}
@@ -0,0 +1,93 @@
+// transport.h:  Reliable messages over the nRF24L01.
+//
+// The radio's auto acknowledge and retransmit give up after 15 tries and
+// then the packet is simply gone (NRF24_MESSAGE_LOST), and a packet is at
+// most 32 bytes.  This layer sits on top and gives whole messages of up to
+// TP_MAX_MSG bytes that arrive complete, once and in order:
+//
+//   - Messages are cut into fragments of up to TP_FRAG_DATA bytes, each sent
+//     as one packet with a sequence number, and put back together at the
+//     other end.
+//   - Up to TP_WINDOW packets can be waiting for an acknowledge at the same
+//     time (sliding window).  The receiver acknowledges with the next
+//     sequence number it expects plus a bitmap of the packets it already has
+//     after that one, so only the missing packets are sent again: after
+//     TP_RTO ticks, or after a round trip when later packets got there.
+//   - Packets received twice (a lost acknowledge) are acknowledged again and
+//     dropped.
+//
+// It does not touch the hardware.  The program passes every received packet
+// to tp_input(), calls tp_poll() often and implements tp_radio_send() and
+// tp_deliver(), so the same code runs on the PIC32 and in Transport_Test.c
+// on a PC, against a simulated radio that loses packets.  Times are in
+// ticks, milliseconds on the PIC32.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+
+#define TP_DATA 0x01 // Packet types, first byte of every packet.  Not
+#define TP_ACK  0x02 // printable, so they can share the radio with text.
+
+#define TP_HEADER    4  // Type, sequence, message number, fragment number
+#define TP_PACKET    32 // nRF24L01 payload limit
+#define TP_FRAG_DATA (TP_PACKET-TP_HEADER)
+#define TP_WINDOW    8  // Packets sent but not acknowledged, at most 8 (bitmap)
+#define TP_TXQ       16 // Packets queued for sending, a power of 2 >= TP_WINDOW
+#define TP_MAX_MSG   256
+#define TP_RTO       20 // Ticks before sending a packet again
+
+#define TP_LAST_FRAG 0x80 // In the fragment number byte
+
+typedef struct {
+	unsigned long msgs_sent, msgs_received;
+	unsigned long pkts_sent, retransmits;
+	unsigned long dups, out_of_order;
+	unsigned long acks_sent, acks_received;
+	unsigned long bytes_delivered;
+	unsigned long rtt_sum, rtt_count, rtt_max; // Ticks, packets sent only once
+} TP_STATS;
+
+typedef struct {
+	uint8_t len;
+	uint8_t sent;    // Times sent
+	uint8_t acked;
+	unsigned long first, last; // When it was first and last sent
+	uint8_t pkt[TP_PACKET];
+} TP_SLOT;
+
+typedef struct {
+	int node;             // For the program, tp_xxx() do not use it
+
+	// Sending
+	TP_SLOT tx[TP_TXQ];
+	uint8_t tx_base;      // Oldest packet not acknowledged
+	uint8_t tx_next;      // Sequence number of the next packet queued
+	uint8_t msg_next;
+	unsigned long srtt;   // Smoothed round trip time, 3 fractional bits
+
+	// Receiving
+	uint8_t rx_next;      // Next sequence number expected
+	uint8_t rx_have[TP_WINDOW]; // Packets after rx_next already here
+	uint8_t rx_len[TP_WINDOW];
+	uint8_t rx_pkt[TP_WINDOW][TP_PACKET];
+	uint8_t msg[TP_MAX_MSG]; // Message being put back together
+	uint16_t msg_len;
+	uint8_t msg_id, frag_next, msg_bad;
+
+	TP_STATS stats;
+} TP;
+
+void tp_init(TP * tp, int node);
+int  tp_send(TP * tp, const uint8_t * msg, uint16_t len); // 0 if there is no room, try again later
+void tp_input(TP * tp, const uint8_t * pkt, uint8_t len, unsigned long now);
+void tp_poll(TP * tp, unsigned long now);   // Sends and resends packets
+int  tp_idle(TP * tp);                      // Everything sent and acknowledged
+
+// Implement these in your code.  tp_radio_send() returns 0 if the packet
+// could not be sent now; it is tried again in the next tp_poll().
+extern int  tp_radio_send(TP * tp, const uint8_t * pkt, uint8_t len);
+extern void tp_deliver(TP * tp, const uint8_t * msg, uint16_t len);
+
+#endif
@@ -0,0 +1,188 @@
+// Freq_Counter_Test.c:  Replays edge times through the reciprocal frequency
+// counter arithmetic (fc_calc.c) on a PC and checks the periods it measures.
+//
+// The edges come from a recording, or are made up for an oscillator at a
+// given frequency with some jitter.  The test does what the hardware does with
+// them: input capture 3 latches the low 16 bits of timer 2 on every
+// FC_EDGES_PER_CAPTURE rising edges, and IC3_Handler() runs some time later,
+// when the timer 2 overflow interrupt may or may not have run yet.  Timer 2
+// starts close to the 32-bit wrap around so that is covered too.  Every gate
+// is compared with the true average period of the same edges, which must
+// agree within the one tick resolution of the two captures.
+//
+// Compile using gcc:
+// gcc Freq_Counter_Test.c fc_calc.c -o Freq_Counter_Test
+//
+// Usage: Freq_Counter_Test [-F<trace>] [-f<Hz>] [-J<ppm>] [-G<us>] [-N<gates>] [-S<seed>] [-V]
+//   -F  Rising edge times in seconds, one per line (the first column of a
+//       logic analyzer CSV export works, lines that are not numbers are skipped)
+//   -f  Made up oscillator frequency when there is no trace (default 55555)
+//   -J  Made up cycle to cycle jitter in ppm, peak (default 200)
+//   -G  Gate time in us (default 2000, FC_GATE_DEFAULT)
+//   -N  Gates to measure from the made up edges (default 1000)
+//   -S  Random seed (default 1)
+//   -V  Print every gate
+//
+// Exits with 1 if any gate is off by more than the resolution.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "freq_counter.h"
+
+#define T2_START    (0xfffeUL*0x10000UL) // Timer 2 ticks at the first edge, 2 overflows before the wrap
+#define ISR_LATENCY 200                  // Ticks, most an interrupt waits for the other one
+#define MAX_EDGES   2000000
+
+static double * edge;
+static long nedges;
+static unsigned long overflow_isr_done; // Overflows counted by the emulated Timer2_Handler()
+
+static double rnd(void)
+{
+	return rand()/(RAND_MAX+1.0);
+}
+
+static int load_trace(char * name)
+{
+	FILE * f;
+	char line[256];
+	double t;
+
+	f=fopen(name, "r");
+	if(f==NULL)
+	{
+		perror(name);
+		return 0;
+	}
+	while(fgets(line, sizeof(line), f) && (nedges<MAX_EDGES))
+	{
+		if(sscanf(line, "%lf", &t)!=1) continue;
+		if((nedges>0) && (t<=edge[nedges-1])) continue; // Not in order, a glitch
+		edge[nedges++]=t;
+	}
+	fclose(f);
+	return 1;
+}
+
+static void make_trace(double hz, double jitter_ppm, double gate_s, long gates)
+{
+	double t=0.0;
+	long n;
+
+	n=(long)(hz*gate_s*1.2*gates)+FC_EDGES_PER_CAPTURE*4;
+	if(n>MAX_EDGES) n=MAX_EDGES;
+	for(nedges=0; nedges<n; nedges++)
+	{
+		edge[nedges]=t;
+		t+=(1.0+(2.0*rnd()-1.0)*jitter_ppm*1.0e-6)/hz;
+	}
+}
+
+// Timer 2 in ticks since the first edge, as a 64-bit count that does not wrap
+static unsigned long long ticks(double t)
+{
+	return (unsigned long long)(t*FC_PBCLK)+T2_START;
+}
+
+// One IC3_Handler() pass for a capture at edge 'j'.  Returns what
+// fc_gate_put() returned.
+static int capture(FC_GATE * g, long j)
+{
+	unsigned long long at, isr, overflows;
+	unsigned long now;
+	int t2if;
+
+	at=ticks(edge[j]);
+	isr=at+(unsigned long long)(rnd()*ISR_LATENCY);
+
+	// The overflow interrupt runs ISR_LATENCY ticks after the roll over at
+	// the latest, or before this one if it came first
+	overflows=isr>>16;
+	while(overflow_isr_done<overflows)
+	{
+		if(((overflow_isr_done+1)<<16)+(unsigned long long)(rnd()*ISR_LATENCY)>isr) break;
+		overflow_isr_done++;
+	}
+	t2if=(overflow_isr_done<overflows);
+
+	now=fc_time((unsigned int)overflow_isr_done, (unsigned int)(isr&0xffff), t2if);
+	return fc_gate_put(g, fc_extend(now, (unsigned int)(at&0xffff)));
+}
+
+int main(int argc, char **argv)
+{
+	FC_GATE g;
+	char trace[256]="";
+	double hz=55555.0, jitter=200.0, gate_us=2000.0;
+	double true_q4, err, worst=0.0, tol;
+	long gates=1000, j, first, done_gates=0, failed=0;
+	long int q4;
+	int verbose=0;
+	unsigned int seed=1;
+
+	for(j=1; j<argc; j++)
+	{
+		if(argv[j][0]!='-') continue;
+		switch(argv[j][1])
+		{
+			case 'F': strcpy(trace, &argv[j][2]); break;
+			case 'f': hz=atof(&argv[j][2]); break;
+			case 'J': jitter=atof(&argv[j][2]); break;
+			case 'G': gate_us=atof(&argv[j][2]); break;
+			case 'N': gates=atol(&argv[j][2]); break;
+			case 'S': seed=atoi(&argv[j][2]); break;
+			case 'V': verbose=1; break;
+		}
+	}
+	srand(seed);
+
+	edge=malloc(sizeof(double)*MAX_EDGES);
+	if(edge==NULL) return 1;
+	if(strlen(trace)>0)
+	{
+		if(!load_trace(trace)) return 1;
+	}
+	else
+	{
+		if(hz<=0.0) return 1;
+		make_trace(hz, jitter, gate_us*1.0e-6, gates);
+	}
+	printf("%ld edges, %.1fms\n", nedges, nedges>1?(edge[nedges-1]-edge[0])*1.0e3:0.0);
+
+	// The capture prescaler counts from when the module was turned on, so
+	// every gate starts at a multiple of FC_EDGES_PER_CAPTURE edges
+	overflow_isr_done=ticks(edge[0])>>16;
+	j=FC_EDGES_PER_CAPTURE-1;
+	while(j<nedges)
+	{
+		fc_gate_start(&g, FC_GATE_US(gate_us));
+		first=j;
+		for(; j<nedges; j+=FC_EDGES_PER_CAPTURE)
+		{
+			if(capture(&g, j)) break;
+		}
+		if(j>=nedges) break; // The recording ended in the middle of this gate
+
+		// Two timestamps, each truncated to a tick
+		q4=fc_gate_period_q4(&g, 1);
+		true_q4=(edge[j]-edge[first])*FC_PBCLK*16.0/(j-first);
+		tol=16.0*2.0/(j-first)+1.0;
+		err=q4-true_q4;
+		if(fabs(err)>worst) worst=fabs(err);
+		if(fabs(err)>tol) failed++;
+		if(verbose || (fabs(err)>tol))
+		{
+			printf("gate %ld: %ld edges, period %.4f ticks, true %.4f, error %+.4f%s\n",
+				done_gates, j-first, q4/16.0, true_q4/16.0, err/16.0, fabs(err)>tol?" FAIL":"");
+		}
+		done_gates++;
+		j+=FC_EDGES_PER_CAPTURE;
+	}
+
+	printf("%ld gates, %ld failed, worst error %.4f ticks\n", done_gates, failed, worst/16.0);
+	free(edge);
+	return (failed>0) || (done_gates==0);
+}
@@ -25,6 +25,18 @@ Here is the backup link of our demo video https://b23.tv/uFK1Qi7
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h> 
+#include "telemetry.h"
+#include "coin_detect.h"
+#include "freq_counter.h"
+#include "odometry.h"
+#include "motor.h"
+#include "robot_logic.h"
+#include "nav.h"
+#include "arm.h"
+#include "delay.h"
+#include "clock.h"
+#include "filter.h"
+#include "perimeter.h"
 // Configuration Bits (somehow XC32 takes care of this)
 #pragma config FNOSC = FRCPLL       // Internal Fast RC oscillator (8 MHz) w/ PLL
 #pragma config FPLLIDIV = DIV_2     // Divide FRC before PLL (now 4 MHz)
@@ -37,16 +49,14 @@ Here is the backup link of our demo video https://b23.tv/uFK1Qi7
 // Defines
 #define SYSCLK 40000000L
 #define FREQ 100000L // We need the ISR for timer 1 every 10 us
-#define Baud2BRG(desired_baud)( (SYSCLK / (16*desired_baud))-1)
+// BRGH=1 (4x) and rounded: within 1.5% of 115200 at both clock_set() speeds
+#define Baud2BRG(hz, desired_baud)( (((hz)+2*(desired_baud)) / (4*(desired_baud)))-1)
 
 
-#define EdgeVoltage 0.1
-#define EdgeVoltage2 0.1
+// Edge thresholds (in ADC counts) and the other strategy constants are in robot_logic.h
 #define MinCoin1Period 19040
 #define MaxCoin1period 19060
 
-#define NoCoinPeriod 7200.0
-
 
 #define LCD_D4 LATAbits.LATA2
 #define LCD_D5 LATAbits.LATA3	
@@ -58,13 +68,24 @@ Here is the backup link of our demo video https://b23.tv/uFK1Qi7
 #define LCD_E  LATAbits.LATA4
 #define LED LATBbits.LATB6
 
+// Set to 1 if the magnet has the two contacts that a coin shorts to ground,
+// wired to RB6 (pin 15) instead of the LED.  Without them the arm waits
+// ARM_DWELL_MS on every coin.
+#define ARM_CONTACT 0
+#define CONTACT_PIN PORTBbits.RB6
+
 #define CHARS_PER_LINE 16
 
 volatile int ISR_pwm1=150, ISR_pwm2=60, ISR_cnt=0;
+volatile int ISR_next1=150, ISR_next2=60; // Pulse widths for the next frame
+#define ISR_PULSES_DONE 300 // Both servo pulses are over by 3ms into the frame
 
 // The Interrupt Service Routine for timer 1 is used to generate one or more standard
 // hobby servo signals.  The servo signal has a fixed period of 20ms and a pulse width
-// between 0.6ms and 2.4ms.
+// between 0.6ms and 2.4ms.  The arm moves in arm.c are advanced once per frame
+// here, and once the arm is back home the interrupt switches itself off.
+// arm_frame() can take longer than one 10us tick, so it runs after both pulses
+// are over, for the next frame, where a late tick does not stretch a pulse.
 void __ISR(_TIMER_1_VECTOR, IPL5SOFT) Timer1_Handler(void)
 {
 	IFS0CLR=_IFS0_T1IF_MASK; // Clear timer 1 interrupt flag, bit 4 of IFS0
@@ -78,9 +99,24 @@ void __ISR(_TIMER_1_VECTOR, IPL5SOFT) Timer1_Handler(void)
 	{
 		LATBbits.LATB14 = 0;
 	}
+	if(ISR_cnt==ISR_PULSES_DONE)
+	{
+		if(arm_idle())
+		{
+			IEC0CLR=_IEC0_T1IE_MASK; // Servo pulses off, the frequency counter still needs interrupts
+		}
+		else
+		{
+			arm_frame();
+			ISR_next1=arm_pwm(0);
+			ISR_next2=arm_pwm(1);
+		}
+	}
 	if(ISR_cnt>=2000)
 	{
 		ISR_cnt=0; // 2000 * 10us=20ms
+		ISR_pwm1=ISR_next1;
+		ISR_pwm2=ISR_next2;
 		LATBbits.LATB15 = 1;
 		LATBbits.LATB14 = 1;
 	}
@@ -90,7 +126,7 @@ void SetupTimer1 (void)
 {
 	// Explanation here: https://www.youtube.com/watch?v=bu6TTZHnMPY
 	__builtin_disable_interrupts();
-	PR1 =(SYSCLK/FREQ)-1; // since SYSCLK/FREQ = PS*(PR1+1)
+	PR1 =(clock_hz()/FREQ)-1; // since SYSCLK/FREQ = PS*(PR1+1)
 	TMR1 = 0;
 	T1CONbits.TCKPS = 0; // 3=1:256 prescale value, 2=1:64 prescale value, 1=1:8 prescale value, 0=1:1 prescale value
 	T1CONbits.TCS = 0; // Clock source
@@ -104,57 +140,14 @@ void SetupTimer1 (void)
 
 }
 
-// Use the core timer to wait for 1 ms.
-void wait_1ms(void)
-{
-    unsigned int ui;
-    _CP0_SET_COUNT(0); // resets the core timer count
-
-    // get the core timer count
-    while ( _CP0_GET_COUNT() < (SYSCLK/(2*1000)) );
-}
-
+// The CPU sleeps during the wait, see delay.c
 void waitms(int len)
 {
-	while(len--) wait_1ms();
+	delay_ms(len);
 }
 
-#define PIN_PERIOD (PORTB&(1<<5))
-
-// GetPeriod() seems to work fine for frequencies between 200Hz and 700kHz.
-long int GetPeriod (int n)
-{
-	int i;
-	unsigned int saved_TCNT1a, saved_TCNT1b;
-	
-    _CP0_SET_COUNT(0); // resets the core timer count
-	while (PIN_PERIOD!=0) // Wait for square wave to be 0
-	{
-		if(_CP0_GET_COUNT() > (SYSCLK/4)) return 0;
-	}
+long int uart_baud;
 
-    _CP0_SET_COUNT(0); // resets the core timer count
-	while (PIN_PERIOD==0) // Wait for square wave to be 1
-	{
-		if(_CP0_GET_COUNT() > (SYSCLK/4)) return 0;
-	}
-	
-    _CP0_SET_COUNT(0); // resets the core timer count
-	for(i=0; i<n; i++) // Measure the time of 'n' periods
-	{
-		while (PIN_PERIOD!=0) // Wait for square wave to be 0
-		{
-			if(_CP0_GET_COUNT() > (SYSCLK/4)) return 0;
-		}
-		while (PIN_PERIOD==0) // Wait for square wave to be 1
-		{
-			if(_CP0_GET_COUNT() > (SYSCLK/4)) return 0;
-		}
-	}
-
-	return  _CP0_GET_COUNT();
-}
- 
 void UART2Configure(int baud_rate)
 {
     // Peripheral Pin Select
@@ -163,11 +156,22 @@ void UART2Configure(int baud_rate)
 
     U2MODE = 0;         // disable autobaud, TX and RX enabled only, 8N1, idle=HIGH
     U2STA = 0x1400;     // enable TX and RX
-    U2BRG = Baud2BRG(baud_rate); // U2BRG = (FPb / (16*baud)) - 1
+    U2MODEbits.BRGH = 1;
+    U2BRG = Baud2BRG(clock_hz(), baud_rate); // U2BRG = (FPb / (4*baud)) - 1
+    uart_baud = baud_rate;
     
     U2MODESET = 0x8000;     // enable UART2
 }
 
+// Called by clock_set() with interrupts off: same baud rate and 10us servo
+// ticks at the new clock.  The rest is done by the modules, see clock.h.
+void clock_changed(unsigned long hz)
+{
+    U2BRG = Baud2BRG(hz, uart_baud);
+    TMR1 = 0;
+    PR1 = (hz/FREQ)-1;
+}
+
 void uart_puts(char * s)
 {
 	while(*s)
@@ -268,6 +272,11 @@ void ConfigurePins(void)
 	
 	LCD_RS = 0;
 	LCD_E = 0;
+
+	#if ARM_CONTACT
+	TRISBbits.TRISB6 = 1; // Magnet contacts instead of the LED
+	CNPUBbits.CNPUB6 = 1;
+	#endif
 }
 
 /*    // Configure pins as analog inputs
@@ -303,49 +312,6 @@ void ConfigurePins(void)
 	INTCONbits.MVEC = 1;*/
 	
 //...............................................................arm related.................................
-void MoveArm(){
-	ISR_pwm1=150, ISR_pwm2=60;
-	LED=!LED;
-	waitms(500);
-	LED=!LED;
-	ISR_pwm2=250;
-	waitms(500);
-	LED=!LED;
-	ISR_pwm1=230;
-	waitms(500);
-	LED=!LED;
-	ISR_pwm1=170;
-	waitms(500);
-	LED=!LED;
-	while (ISR_pwm2 > 100){
-		ISR_pwm2--;
-		waitms(6);
-	}	
-//	ISR_pwm2=100;
-	waitms(500);
-	LED=!LED;
-	while (ISR_pwm1 > 100){
-		ISR_pwm1--;
-		waitms(6);
-	}	
-	//ISR_pwm1=100;
-    waitms(500);
-    LED = 0;
-}  
-
- 
-void ArmInit(){
-
-	waitms(100);
-	ISR_pwm1=150;
- 	waitms(500);
-   	ISR_pwm2=60;   //picking up coins (might want to add longer delay)
- 	waitms(500);
- 	
- 	
-} 
- 
- 	
 void StartMagnet(){
 	TRISBbits.TRISB4 = 1;	
 }   	
@@ -356,91 +322,16 @@ void StopMagnet(){
 
 
 //.................................................servo................................
-void MoveForward(){
-//wheel 1
-	TRISAbits.TRISA0 = 0; //pin 2
-	TRISAbits.TRISA1 = 1; //pin 3
-//wheel 2
-	TRISBbits.TRISB0 = 1; // pin  4 of DIP28
-	TRISBbits.TRISB1 = 0; // pin  5 of DIP28
-}
+// The wheels are driven by odometry.c: speed is held by a PI loop on the
+// wheel encoders and turns end by angle instead of by time.
+#define ODO_STALL_MS 300 // Give up a turn if the encoders stop counting this long
 
-void MoveBackward(){
-//wheel 1
-	TRISAbits.TRISA0 = 1;
-	TRISAbits.TRISA1 = 0;
-//wheel 2
-	TRISBbits.TRISB0 = 0; // pin  4 of DIP28
-	TRISBbits.TRISB1 = 1; // pin  5 of DIP28
-	waitms(175);
+void MoveForward(){
+	odo_drive(ODO_SPEED_NORMAL);
 }
 
 void Stop(){
-//wheel 1
-	TRISAbits.TRISA0 = 0;
-	TRISAbits.TRISA1 = 0;
-//wheel 2
-	TRISBbits.TRISB0 = 0; // pin  4 of DIP28
-	TRISBbits.TRISB1 = 0; // pin  5 of DIP28
-}
-
-void TurnDirectionForCoin(){
-//wheel 1
-
-// int t=0;
-	TRISAbits.TRISA0 = 1;
-	TRISAbits.TRISA1 = 0;
-//wheel 2
-	TRISBbits.TRISB0 = 1; // pin  4 of DIP28
-	TRISBbits.TRISB1 = 0; // pin  5 of DIP28
-	
-//	for(t=0;t<=5000;t++){
-//	TRISBbits.TRISB4=!TRISBbits.TRISB4;
-//	}
-	
-	waitms(20);//Time needed to turn to pick a coin
-}
-void TurnAnotherDirection(){
-//wheel 1
-
-// int t=0;
-	TRISAbits.TRISA0 = 0;
-	TRISAbits.TRISA1 = 1;
-//wheel 2
-	TRISBbits.TRISB0 = 0; // pin  4 of DIP28
-	TRISBbits.TRISB1 = 1; // pin  5 of DIP28
-	
-//	for(t=0;t<=5000;t++){
-//	TRISBbits.TRISB4=!TRISBbits.TRISB4;
-//	}
-	
-	waitms(20);//Time needed to turn to pick a coin
-}
-void TurnDirectionForWall(){
-//wheel 1
-
-//	int t=0;
-	TRISAbits.TRISA0 = 1;
-	TRISAbits.TRISA1 = 0;
-//wheel 2
-	TRISBbits.TRISB0 = 1; // pin  4 of DIP28
-	TRISBbits.TRISB1 = 0; // pin  5 of DIP28
-	
-//	for(t=0;t<=5000;t++){
-//	TRISBbits.TRISB4=!TRISBbits.TRISB4;
-//	}
-	
-	waitms(75);//Time needed to turn to pick a coin
-}
-
-
-void MoveSlow(){
-	MoveForward();
-	waitms(5);
-	Stop();
-	waitms(5);
-	MoveForward();
-	
+	odo_stop();
 }
 
 //............................................................lcd display...................
@@ -516,154 +407,208 @@ void LCDprint(char* string, unsigned char line, int clear)
 
 
 //.................................................................Detection..........................
+// Edge sensors.  A reading is the median of three groups of 16 conversions,
+// each group oversampled to 12 bits: a spike from the motor PWM spoils one
+// group only.  Back to 10 bit counts for the EdgeThreshold compare.  The 48
+// conversions take about 130us, the busy wait that used to come first took
+// milliseconds.  The median is not taken over earlier readings, they can be
+// from before the last turn.
+// EDGE_SYNC (robot_logic.h) reads the synchronous detector in perimeter.c instead.
+#define EDGE_OS_BITS 2
+
+int EdgeRead(char pin)
+{
+	FILT_OS os;
+	long v[3];
+	int j;
+
+	for(j=0; j<3; j++)
+	{
+		filt_os_init(&os, EDGE_OS_BITS);
+		while(!filt_os_put(&os, ADCRead(pin)));
+		v[j]=os.out;
+	}
+	return filt_round(filt_median3(v[0], v[1], v[2]), EDGE_OS_BITS);
+}
+
 int getEdge(){
-	int EdgeCounter;
-	EdgeCounter=0;
-    int adcval;
-    float voltage;
-	while(EdgeCounter<50001){
-	EdgeCounter++;	 	
-		if(EdgeCounter==50000)
-		{
-        	adcval = ADCRead(5); // note that we call pin AN5 (RB3) by it's analog number
-        	voltage=adcval*3.3/1023.0;
-			EdgeCounter = 0;
-			printf("Volage: %f\r\n",voltage);
-				return voltage;
-}}
+#if EDGE_SYNC
+	return perim_amplitude(5);
+#else
+	return EdgeRead(5); // note that we call pin AN5 (RB3) by it's analog number
+#endif
 }
 int getEdge2(){
-	int EdgeCounter;
-	EdgeCounter=0;
-    int adcval;
-    float voltage;
-    	  	   		
-	while(EdgeCounter<50001){
-	EdgeCounter++;	
-		if(EdgeCounter==50000)
-		{
-        	adcval = ADCRead(4); // note that we call pin AN5 (RB2) by it's analog number
-        	voltage=adcval*3.3/1023.0;
-			EdgeCounter = 0;
-			printf("Volage2: %f\r\n",voltage);
-				return voltage;
-}}
+#if EDGE_SYNC
+	return perim_amplitude(4);
+#else
+	return EdgeRead(4); // AN4 (RB2)
+#endif
 }
+// The no-coin period is learned at startup and tracked by coin_detect.c,
+// so there is no hard-coded NoCoinPeriod to retune for every build.
+// The period comes from the reciprocal counter in freq_counter.c: a fixed 2ms
+// gate with 1/PBCLK resolution, instead of polling 20 whole periods.
 int getCoin(){
 	long int CoinCounter=0;
-//	float T, f;
-	CoinCounter=GetPeriod(20);
-	printf("%d\n",CoinCounter);
-	if(CoinCounter>0)
-		{	  	   		
-//			T=(CoinCounter*2.0)/(SYSCLK*100.0);
-//			f=1/T;
-			if(CoinCounter<NoCoinPeriod)
-				return 1;
-			else
-				return 0;
-		}
-	else 
-		return 0;
+	CoinCounter=fc_measure(FC_GATE_DEFAULT);
+	tlm_period(CoinCounter);
+	return coin_update(CoinCounter);
+}
+
+// Learn the no-coin baseline.  Keep the robot away from coins for this.
+void CoinCalibrate(){
+	coin_init();
+	while(coin_learning())
+	{
+		coin_update(fc_measure(FC_GATE_DEFAULT));
+	}
 }
 
 void dance(){
 
-	TurnDirectionForCoin();
+	odo_spin(ODO_SPEED_NORMAL);
 	waitms(2000);
-	TurnAnotherDirection();
+	odo_spin(-ODO_SPEED_NORMAL);
 	waitms(2000);
 	Stop();
 
 }
 
+//.................................................platform functions for robot_logic.c
+int robot_edge(int sensor)
+{
+	static int edge;
+
+	if(sensor==0) return edge=getEdge();
+	sensor=getEdge2();
+	tlm_edge(edge, sensor);
+	return sensor;
+}
+
+int robot_coin(void)
+{
+	return getCoin();
+}
+
+void robot_drive(int speed)
+{
+	odo_drive(speed);
+}
+
+void robot_stop(void)
+{
+	Stop();
+}
+
+void robot_turn(int deg, int speed)
+{
+	odo_turn(deg, speed);
+	odo_wait(ODO_STALL_MS);
+}
+
+void robot_wait(int ms)
+{
+	waitms(ms);
+}
+
+void robot_arm(int move)
+{
+	arm_move(move);
+	if(!IEC0bits.T1IE)
+	{
+		// Servo pulses were off: work out the first frame of the move here
+		// and start it right away
+		arm_frame();
+		ISR_next1=arm_pwm(0);
+		ISR_next2=arm_pwm(1);
+		ISR_cnt=1999;
+		IFS0bits.T1IF = 0;
+		IEC0bits.T1IE = 1;
+	}
+}
+
+void robot_magnet(int on)
+{
+	if(on) StartMagnet();
+	else StopMagnet();
+	#if ARM_CONTACT==0
+	LED=on;
+	#endif
+}
+
+int robot_contact(void)
+{
+	#if ARM_CONTACT
+	return CONTACT_PIN==0;
+	#else
+	return -1;
+	#endif
+}
+
+void robot_show_coins(int coins)
+{
+	char tempstring[CHARS_PER_LINE+1];
+
+	LCDprint("# of Coins",1,1);
+	sprintf(tempstring,"%d",coins);
+	LCDprint(tempstring,2,1);
+	tlm_coins(coins);
+}
+
+long int robot_travel(void)
+{
+	return ODO_COUNTS_TO_MM((odo_count(0)+odo_count(1))/2);
+}
+
+void robot_event(int event)
+{
+	if(event==ROBOT_EV_EDGE) tlm_event(TLM_EV_EDGE);
+	else if(event==ROBOT_EV_COIN) tlm_event(TLM_EV_COIN);
+}
+
 // In order to keep this as nimble as possible, avoid
 // using floating point or printf() on any of its forms!
 void main(void)
 {	
-	unsigned char buf[8];
-	int EdgeCounter=0;
-	volatile unsigned long t=0;
-    int adcval;
-    char tempstring []= "# of Coins: " ;
-
-    long int v;
-	unsigned long int count, f;
-	unsigned char LED_toggle=0;
-	float EdgeDetected=0;
-	float EdgeDetected2=0;
-	int CoinDetected=0;
-	volatile unsigned long CurrentPeriod=0;
 	DDPCON = 0;
 	CFGCON = 0;
-	int Coins=0;
     UART2Configure(115200);  // Configure UART2 for a baud rate of 115200
+    tlm_init(); // Binary telemetry, decode with Telemetry_Decoder
+    tlm_event(TLM_EV_START);
     ConfigurePins();
  
     ADCConf(); // Configure ADC    
+    arm_init();
+    SetupTimer1(); // Stops by itself, the arm is home
+    fc_init();
+    motor_init();
+#if EDGE_SYNC
+    perim_init(); // Takes the ADC over, sampling on the timer 3 PWM period
+#endif
+    odo_init();
+    delay_init();
+    __builtin_enable_interrupts();
+    CoinCalibrate();
 	LCD_4BIT();
 	WriteCommand(0x01);
-//	float EdgeVoltage;
- 
-	while(1)
-	{	LCDprint("# of Coins",1,1);
-		sprintf(tempstring,"%d",Coins);
-		LCDprint(tempstring,2,1);
-		EdgeCounter++;
-		EdgeDetected=getEdge();
-		EdgeDetected2=getEdge2();
-		CoinDetected=getCoin();
-		
 
-//..............................................main function
-
-//..............................................................turning to pick coin
-		MoveForward(); 
-		//printf("%d\n",CoinDetected);
-		if(CoinDetected==0 && EdgeDetected<1.0&& EdgeDetected2<0.2){
-			//while(CoinDetected==0 && EdgeDetected<1.0&& EdgeDetected2<0.2){
-			printf("%d\n",CoinDetected);
-		//	}
-
-   		}
-   		else if (CoinDetected==1){
-   			SetupTimer1();
-			__builtin_enable_interrupts();
-   			Coins=Coins+1;
-   			MoveBackward();
-   			waitms(55);
-   			Stop();
-   			TurnDirectionForCoin();
-   			Stop();
-   			waitms(60);//Time needed to finish the turn direction operatoion(for picking coin)
-   			StartMagnet();
-  			MoveArm();
-   			waitms(1000);
-   			StopMagnet();
-   			ArmInit();		
-   			__builtin_disable_interrupts();
- 		}  
- 		else if (EdgeDetected>EdgeVoltage|| EdgeDetected2>EdgeVoltage2){
- 			printf("Edge detected");
-   			MoveBackward();
-			waitms(500);
- 			Stop();
- 			TurnDirectionForWall();
- 			waitms(200);//Time needed to finish the turn direction operatoion(for picking coin)
-   			
-   		}
-		
-    		EdgeDetected=0;
-    		EdgeDetected2=0;
-   			CoinDetected=0;
-   		
-		if (Coins==20)
-		{
-			LCDprint("Mission Complete",1,1);
-			LCDprint("            ",2,1);
-			dance();
-			Stop();
-			return;
-		}
-	}
-}
\ No newline at end of file
+	// The strategy is in robot_logic.c, so it can also run in Robot_Sim.c
+	nav_seed(_CP0_GET_COUNT());
+	robot_run(ROBOT_NAV);
+
+#if EDGE_SYNC
+	perim_stop(); // Its interrupt would keep waking delay_idle() up
+#endif
+	LCDprint("Mission Complete",1,1);
+	tlm_event(TLM_EV_DONE);
+	LCDprint("            ",2,1);
+	dance();
+	Stop();
+
+	// Only the LCD is left to look at: once the servo timer has stopped,
+	// drop to the slow clock and sleep
+	while(IEC0bits.T1IE) waitms(ARM_FRAME_MS);
+	clock_set(CLOCK_SLOW);
+	while(1) delay_idle();
+}
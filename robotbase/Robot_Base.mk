@@ -2,17 +2,59 @@ SHELL=cmd
 CC = xc32-gcc
 OBJCPY = xc32-bin2hex
 ARCH = -mprocessor=32MX130F064B
-OBJ = Robot_Base.o
+OBJ = Robot_Base.o telemetry.o coin_detect.o freq_counter.o fc_calc.o odometry.o motor.o robot_logic.o nav.o arm.o traj.o delay.o clock.o filter.o perimeter.o
 PORTN=$(shell type COMPORT.inc)
 
 Robot_Base.elf: $(OBJ)
-	$(CC) $(ARCH) -o Robot_Base.elf Robot_Base.o -mips16 -DXPRJ_default=default -legacy-libc -Wl,-Map=Robot_Base.map
+	$(CC) $(ARCH) -o Robot_Base.elf $(OBJ) -mips16 -DXPRJ_default=default -legacy-libc -Wl,-Map=Robot_Base.map
 	$(OBJCPY) Robot_Base.elf
 	@echo Success!
    
 Robot_Base.o: Robot_Base.c
 	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o Robot_Base.o Robot_Base.c -DXPRJ_default=default -legacy-libc
 
+telemetry.o: telemetry.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o telemetry.o telemetry.c -DXPRJ_default=default -legacy-libc
+
+coin_detect.o: coin_detect.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o coin_detect.o coin_detect.c -DXPRJ_default=default -legacy-libc
+
+freq_counter.o: freq_counter.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o freq_counter.o freq_counter.c -DXPRJ_default=default -legacy-libc
+
+fc_calc.o: fc_calc.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o fc_calc.o fc_calc.c -DXPRJ_default=default -legacy-libc
+
+odometry.o: odometry.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o odometry.o odometry.c -DXPRJ_default=default -legacy-libc
+
+motor.o: motor.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o motor.o motor.c -DXPRJ_default=default -legacy-libc
+
+robot_logic.o: robot_logic.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o robot_logic.o robot_logic.c -DXPRJ_default=default -legacy-libc
+
+nav.o: nav.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o nav.o nav.c -DXPRJ_default=default -legacy-libc
+
+arm.o: arm.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o arm.o arm.c -DXPRJ_default=default -legacy-libc
+
+delay.o: delay.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o delay.o delay.c -DXPRJ_default=default -legacy-libc
+
+clock.o: clock.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o clock.o clock.c -DXPRJ_default=default -legacy-libc
+
+filter.o: filter.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o filter.o filter.c -DXPRJ_default=default -legacy-libc
+
+perimeter.o: perimeter.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o perimeter.o perimeter.c -DXPRJ_default=default -legacy-libc
+
+traj.o: traj.c
+	$(CC) -mips16 -g -x c -c $(ARCH) -MMD -o traj.o traj.c -DXPRJ_default=default -legacy-libc
+
 clean:
 	@del *.o *.elf *.hex *.d *.map 2>NUL
 	
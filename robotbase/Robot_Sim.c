@@ -0,0 +1,419 @@
+// Robot_Sim.c:  PC simulator for the coin collecting robot.
+//
+// Runs the same strategy code as the robot (robot_logic.c, nav.c, arm.c,
+// traj.c and coin_detect.c) against a model of the field: a rectangular
+// arena bounded by the perimeter wire, coins at random places, the two edge
+// sensors, the metal detector, the arm with contacts on its magnet and a
+// differential drive robot.  Each platform function advances the simulated
+// clock by the time the real one takes on the PIC32, and the arm moves are
+// advanced every 20ms like in the servo interrupt, so the reported mission
+// time is comparable between strategy changes.
+//
+// Compile using gcc:
+// gcc Robot_Sim.c robot_logic.c nav.c arm.c traj.c coin_detect.c filter.c -o Robot_Sim -lm
+//
+// Usage: Robot_Sim [-N<runs>] [-S<seed>] [-P<policy>] [-V]
+//   -N  Number of missions to run, each one with a different coin layout (default 20)
+//   -S  Seed of the first layout (default 1)
+//   -P  Search pattern from nav.h, by number or name (default ROBOT_NAV)
+//   -V  Print every event of every mission
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <setjmp.h>
+#include "robot_logic.h"
+#include "nav.h"
+#include "arm.h"
+#include "coin_detect.h"
+#include "odometry.h"
+#include "filter.h"
+#include "perimeter.h"
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+// Field
+#define ARENA_W_MM     1200.0 // Inside of the perimeter wire
+#define ARENA_H_MM      900.0
+#define WIRE_DECAY_MM    40.0 // Edge sensor reading falls to 1/e every 40mm from the wire
+#define WIRE_NOISE         6  // ADC counts, peak
+#define COIN_MARGIN_MM   60.0 // Coins are at least this far from the wire
+#define COIN_RADIUS_MM   12.0
+
+// Robot geometry, robot frame: x forward, y to the left, origin between the wheels
+#define SENSOR_X_MM      70.0 // Edge sensors, front left and front right
+#define SENSOR_Y_MM      55.0
+#define COIL_X_MM        80.0 // Metal detector coil
+#define COIL_RANGE_MM    20.0 // Coin to coil distance where the detector stops seeing it
+#define ARM_REACH_MM     30.0 // Magnet picks a coin within this distance of its target
+#define ARM_DOWN_PWM      110 // Servo 2 at or below this puts the magnet on the floor
+#define TURN_ERROR_DEG    1.0 // Peak error of a turn, on top of the encoder resolution
+#define START_ERROR_DEG   3.0 // The robot is put down square to the arena, give or take this
+
+// Metal detector, as returned by fc_measure() (PBCLK ticks, 4 fractional bits)
+#define PERIOD_Q4     11520.0
+#define PERIOD_NOISE  0.0015 // Relative, peak
+#define PERIOD_SHIFT  0.030  // Relative shift with a coin right under the coil
+
+// Time taken by the platform functions on the robot
+#define SIM_EDGE_MS      0    // getEdge(): 48 conversions, about 130us
+#define EDGE_OS_BITS     2    // As in Robot_Base.c
+#define SIM_COIN_MS      2    // Frequency counter gate
+#define SIM_LCD_MS     186    // Two lines with LCDprint()
+#define SIM_MOTOR_TAU_MS 50.0 // Wheel speed time constant
+
+#define SIM_TIMEOUT_MS (30L*60L*1000L)
+#define MM_PER_COUNT (M_PI*ODO_WHEEL_DIAM_MM/ODO_CPR)
+
+#define END_DONE    0
+#define END_ESCAPE  1
+#define END_TIMEOUT 2
+
+typedef struct {
+	double x, y;
+	int picked;
+} COIN;
+
+static COIN coin[ROBOT_COINS];
+static double rx, ry, rh;        // Robot position (mm) and heading (rad)
+static double v_set[2], v_now[2]; // Wheel speeds in mm/s, 0 is the left wheel
+static double travel;            // Odometer, mm
+static double arm_x, arm_y;      // Where the magnet lands, robot frame
+static long sim_ms;
+static int counted, picked, edges, verbose, turn_noise;
+static int magnet, holding;
+static unsigned long rng;
+static jmp_buf sim_end;
+
+// Small generator, so the layouts are the same with every C library
+static double rnd(void)
+{
+	rng^=rng<<13;
+	rng^=rng>>17;
+	rng^=rng<<5;
+	return (rng&0xffffff)/16777216.0;
+}
+
+static void to_world(double bx, double by, double * wx, double * wy)
+{
+	*wx=rx+bx*cos(rh)-by*sin(rh);
+	*wy=ry+bx*sin(rh)+by*cos(rh);
+}
+
+static double wire_distance(double x, double y)
+{
+	double d=x;
+	if(ARENA_W_MM-x<d) d=ARENA_W_MM-x;
+	if(y<d) d=y;
+	if(ARENA_H_MM-y<d) d=ARENA_H_MM-y;
+	return d;
+}
+
+// Move the world forward 'ms' milliseconds, one millisecond at a time
+static void advance(long ms)
+{
+	double v, w, k;
+	int i;
+
+	k=1.0-exp(-1.0/SIM_MOTOR_TAU_MS);
+	while(ms-->0)
+	{
+		for(i=0; i<2; i++) v_now[i]+=(v_set[i]-v_now[i])*k;
+		v=(v_now[0]+v_now[1])/2.0;
+		w=(v_now[1]-v_now[0])/ODO_WHEEL_BASE_MM;
+		rx+=v*cos(rh)/1000.0;
+		ry+=v*sin(rh)/1000.0;
+		rh+=w/1000.0;
+		travel+=v/1000.0;
+		sim_ms++;
+		if(sim_ms%ARM_FRAME_MS==0) arm_frame();
+
+		if(wire_distance(rx, ry)<0) longjmp(sim_end, END_ESCAPE);
+		if(sim_ms>=SIM_TIMEOUT_MS) longjmp(sim_end, END_TIMEOUT);
+	}
+}
+
+static long int coil_period(void)
+{
+	double cx, cy, d, shift;
+	int i;
+
+	to_world(COIL_X_MM, 0, &cx, &cy);
+	shift=0;
+	for(i=0; i<ROBOT_COINS; i++)
+	{
+		if(coin[i].picked) continue;
+		d=hypot(coin[i].x-cx, coin[i].y-cy)/COIL_RANGE_MM;
+		if(d<1.0) shift+=PERIOD_SHIFT*(1.0-d*d);
+	}
+	return (long int)(PERIOD_Q4*(1.0+shift+PERIOD_NOISE*(2.0*rnd()-1.0)));
+}
+
+/* -------------------------------------------------------------------------- */
+/* Platform functions for robot_logic.c                                       */
+/* -------------------------------------------------------------------------- */
+// The same filters as getEdge(): median of 3 oversampled groups, or with
+// EDGE_SYNC the tone, 'level' peak to peak around mid scale at a random
+// phase, sampled at PERIM_FS/4.  The detector runs in the background on the
+// robot, so this takes no time, and the reading is at most one block old.
+// The tone is as strong as the old reading here, so the simulator can not
+// tell whether EdgeSyncVoltage is right.
+int robot_edge(int sensor)
+{
+	double sx, sy, level;
+	int counts, j;
+	long v[3];
+	FILT_OS os;
+	FILT_IQ iq;
+	double phase;
+
+	to_world(SENSOR_X_MM, sensor==0?SENSOR_Y_MM:-SENSOR_Y_MM, &sx, &sy);
+	advance(SIM_EDGE_MS);
+	level=ADC_FULL_SCALE*exp(-wire_distance(sx, sy)/WIRE_DECAY_MM);
+	if(EDGE_SYNC)
+	{
+		filt_iq_init(&iq, PERIM_CYCLES);
+		phase=2.0*M_PI*rnd();
+		for(j=0; ; j++)
+		{
+			counts=(int)(ADC_FULL_SCALE/2+level/2*cos(phase+j*M_PI/2)+(2.0*rnd()-1.0)*WIRE_NOISE);
+			if(counts<0) counts=0;
+			if(counts>ADC_FULL_SCALE) counts=ADC_FULL_SCALE;
+			if(filt_iq_put(&iq, counts)) return iq.out;
+		}
+	}
+	for(j=0; j<3; j++)
+	{
+		filt_os_init(&os, EDGE_OS_BITS);
+		do
+		{
+			counts=(int)(level+(2.0*rnd()-1.0)*WIRE_NOISE);
+			if(counts<0) counts=0;
+			if(counts>ADC_FULL_SCALE) counts=ADC_FULL_SCALE;
+		} while(!filt_os_put(&os, counts));
+		v[j]=os.out;
+	}
+	return filt_round(filt_median3(v[0], v[1], v[2]), EDGE_OS_BITS);
+}
+
+int robot_coin(void)
+{
+	advance(SIM_COIN_MS);
+	return coin_update(coil_period());
+}
+
+void robot_drive(int speed)
+{
+	v_set[0]=v_set[1]=speed*MM_PER_COUNT;
+}
+
+void robot_stop(void)
+{
+	v_set[0]=v_set[1]=0;
+}
+
+// odo_turn() stops after a whole number of encoder counts
+void robot_turn(int deg, int speed)
+{
+	double v, h, h0;
+
+	if(speed<0) speed=-speed;
+	if(deg==0 || speed==0) return;
+	v=(deg>0?speed:-speed)*MM_PER_COUNT;
+	h0=rh;
+	v_set[0]=-v;
+	v_set[1]=v;
+	advance((long)(ODO_DEG_TO_COUNTS(abs(deg))*1000L/speed));
+	v_set[0]=v_set[1]=v_now[0]=v_now[1]=0;
+	// Land on the angle the encoders measured, whatever the motor lag did
+	h=ODO_DEG_TO_COUNTS(abs(deg))*MM_PER_COUNT*2.0/ODO_WHEEL_BASE_MM;
+	rh=h0+(deg>0?h:-h);
+	if(turn_noise) rh+=(2.0*rnd()-1.0)*TURN_ERROR_DEG*M_PI/180.0;
+}
+
+void robot_wait(int ms)
+{
+	advance(ms);
+}
+
+void robot_arm(int move)
+{
+	arm_move(move);
+}
+
+void robot_magnet(int on)
+{
+	magnet=on;
+	if(!on) holding=0;
+}
+
+// The magnet gets a coin if it comes down within reach of one
+int robot_contact(void)
+{
+	double mx, my;
+	int i;
+
+	if(holding) return 1;
+	if(!magnet || arm_pwm(1)>ARM_DOWN_PWM) return 0;
+	to_world(arm_x, arm_y, &mx, &my);
+	for(i=0; i<ROBOT_COINS; i++)
+	{
+		if(coin[i].picked) continue;
+		if(hypot(coin[i].x-mx, coin[i].y-my)<ARM_REACH_MM)
+		{
+			coin[i].picked=1;
+			picked++;
+			holding=1;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void robot_show_coins(int coins)
+{
+	counted=coins;
+	advance(SIM_LCD_MS);
+}
+
+long int robot_travel(void)
+{
+	return (long int)travel;
+}
+
+void robot_event(int event)
+{
+	if(event==ROBOT_EV_EDGE) edges++;
+	if(verbose) printf("  %7.3fs %s at (%4.0f,%4.0f)\n", sim_ms/1000.0,
+		event==ROBOT_EV_EDGE?"edge":"coin", rx, ry);
+}
+
+/* -------------------------------------------------------------------------- */
+
+// Where a coin found right under the coil ends up, relative to the robot,
+// after the robot_logic.c coin sequence: back up COIN_BACK_MS, turn
+// COIN_TURN_DEG and settle.  The arm is built to land there.
+static void arm_target(void)
+{
+	double dx, dy;
+
+	rx=ARENA_W_MM/2;
+	ry=ARENA_H_MM/2;
+	rh=0;
+	sim_ms=0;
+	v_set[0]=v_set[1]=v_now[0]=v_now[1]=ROBOT_SPEED*MM_PER_COUNT;
+	if(setjmp(sim_end)==0)
+	{
+		robot_drive(-ROBOT_SPEED);
+		advance(COIN_BACK_MS);
+		robot_stop();
+		robot_turn(COIN_TURN_DEG, ROBOT_SPEED_SLOW);
+		advance(60);
+	}
+	dx=ARENA_W_MM/2+COIL_X_MM-rx;
+	dy=ARENA_H_MM/2-ry;
+	arm_x=dx*cos(rh)+dy*sin(rh);
+	arm_y=-dx*sin(rh)+dy*cos(rh);
+}
+
+static void place_coins(void)
+{
+	int i, j, ok;
+
+	for(i=0; i<ROBOT_COINS; i++)
+	{
+		do {
+			coin[i].x=COIN_MARGIN_MM+rnd()*(ARENA_W_MM-2*COIN_MARGIN_MM);
+			coin[i].y=COIN_MARGIN_MM+rnd()*(ARENA_H_MM-2*COIN_MARGIN_MM);
+			coin[i].picked=0;
+			// Keep the start area clear for the coin detector calibration
+			ok=hypot(coin[i].x-rx-COIL_X_MM, coin[i].y-ry)>4*COIL_RANGE_MM;
+			for(j=0; j<i && ok; j++)
+				if(hypot(coin[i].x-coin[j].x, coin[i].y-coin[j].y)<2*COIN_RADIUS_MM) ok=0;
+		} while(!ok);
+	}
+}
+
+static int mission(int policy, unsigned long seed, long * ms)
+{
+	volatile int result;
+
+	rng=seed*2654435761UL+1;
+	rx=ARENA_W_MM/2;
+	ry=ARENA_H_MM/2;
+	rh=((int)(rnd()*4)*90+(2.0*rnd()-1.0)*START_ERROR_DEG)*M_PI/180.0;
+	v_set[0]=v_set[1]=v_now[0]=v_now[1]=0;
+	travel=0;
+	turn_noise=1;
+	magnet=holding=0;
+	arm_init();
+	sim_ms=0;
+	picked=0;
+	edges=0;
+	place_coins();
+
+	coin_init();
+	while(coin_learning()) coin_update(coil_period());
+
+	counted=0;
+	result=setjmp(sim_end);
+	if(result==0)
+	{
+		nav_seed(seed);
+		robot_run(policy);
+		result=END_DONE;
+	}
+	*ms=sim_ms;
+	return result;
+}
+
+int main(int argc, char ** argv)
+{
+	int j, runs=20, result, done=0, policy=ROBOT_NAV;
+	unsigned long seed=1;
+	long ms;
+	double total_s=0, total_picked=0;
+	const char * end_name[]={"done", "ESCAPED", "TIMEOUT"};
+
+	for(j=1; j<argc; j++)
+	{
+		if(argv[j][0]=='-' && (argv[j][1]=='N' || argv[j][1]=='n')) runs=atoi(&argv[j][2]);
+		else if(argv[j][0]=='-' && (argv[j][1]=='S' || argv[j][1]=='s')) seed=strtoul(&argv[j][2], NULL, 10);
+		else if(argv[j][0]=='-' && (argv[j][1]=='V' || argv[j][1]=='v')) verbose=1;
+		else if(argv[j][0]=='-' && (argv[j][1]=='P' || argv[j][1]=='p'))
+		{
+			for(policy=0; policy<NAV_POLICIES; policy++)
+				if(strcmp(&argv[j][2], nav_name[policy])==0) break;
+			if(policy==NAV_POLICIES) policy=atoi(&argv[j][2]);
+			if(policy<0 || policy>=NAV_POLICIES) policy=ROBOT_NAV;
+		}
+		else
+		{
+			printf("Usage: %s [-N<runs>] [-S<seed>] [-P<policy>] [-V]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	arm_target();
+	printf("# Search pattern: %s\n", nav_name[policy]);
+	printf("seed,result,time_s,counted,picked,edges,coins_per_min\n");
+	for(j=0; j<runs; j++)
+	{
+		result=mission(policy, seed+j, &ms);
+		printf("%lu,%s,%.1f,%d,%d,%d,%.2f\n", seed+j, end_name[result], ms/1000.0,
+			counted, picked, edges, picked*60000.0/ms);
+		fflush(stdout);
+		if(result==END_DONE) done++;
+		total_s+=ms/1000.0;
+		total_picked+=picked;
+	}
+	if(runs>0)
+	{
+		printf("# %d of %d missions completed, mean time %.1fs, %.2f coins per minute\n",
+			done, runs, total_s/runs, total_picked*60.0/total_s);
+	}
+	return 0;
+}
@@ -0,0 +1,248 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// Telemetry_Decoder.c:  Decodes the binary telemetry frames sent by
+// Robot_Base.c (see telemetry.h) and writes them as CSV, one line per frame:
+//
+//   time_us,message,value1,value2
+//
+// Frames with a bad CRC are counted and skipped; the decoder then resyncs on
+// the next SYNC byte, including the ones inside the bad frame.
+//
+// For Linux and macOS:
+// gcc Telemetry_Decoder.c -o Telemetry_Decoder
+//
+// Usage examples:
+// ./Telemetry_Decoder -D/dev/ttyUSB0 > run1.csv   (decode live from the serial port)
+// ./Telemetry_Decoder -Fcapture.bin > run1.csv    (decode a raw capture file)
+//
+
+#ifdef __APPLE__
+	#include <termios.h>
+#else
+	#include <termio.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#define TLM_HOST_ONLY
+#include "telemetry.h"
+
+int fd=-1;
+char SerialPort[PATH_MAX]="";
+char InName[PATH_MAX]="";
+struct termios comio;
+
+unsigned long tick_hz=40000000L/256L; // Until a TLM_ID_CLOCK frame says otherwise
+unsigned long base_t=0;  // Timestamp of the last rate change...
+double base_us=0.0;      // ...and its time in us
+unsigned long frames=0, crc_errors=0;
+
+int OpenSerialPort(char * devicename)
+{
+	fd = open(devicename, O_RDWR | O_NOCTTY | O_NDELAY );
+	if (fd < 0)
+	{
+		perror(devicename);
+		return(1);
+	}
+	fcntl(fd, F_SETFL, 0);
+
+	tcgetattr(fd, &comio);
+	cfsetospeed(&comio, B115200);
+	cfsetispeed(&comio, B115200);
+	comio.c_cflag = B115200 | CS8 | CLOCAL | CREAD;
+	comio.c_cflag &= ~(CRTSCTS); /* No hardware flow control */
+	comio.c_iflag = IGNPAR;
+	comio.c_iflag &= ~(IXON | IXOFF | IXANY); /* No software flow control */
+	comio.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG); /* Raw input mode*/
+	comio.c_oflag &= ~OPOST; /* Raw ouput mode */
+	comio.c_cc[VMIN]=1;
+	comio.c_cc[VTIME]=0;
+	tcflush(fd, TCIFLUSH);
+	tcsetattr(fd, TCSANOW, &comio);
+
+	return(0);
+}
+
+// Returns the next byte from the input or -1 at the end of the input
+int get_byte(void)
+{
+	unsigned char c;
+
+	if(read(fd, &c, 1)!=1) return -1;
+	return c;
+}
+
+unsigned short crc16_ccitt(unsigned char val, unsigned short crc)
+{
+	unsigned char i;
+	crc = crc ^ ((unsigned short)val << 8);
+	for (i=0; i<8; i++)
+	{
+		if (crc & 0x8000) crc = (crc << 1) ^ 0x1021;
+		else crc <<= 1;
+	}
+	return crc;
+}
+
+unsigned long get_u32(unsigned char * p)
+{
+	return p[0] | ((unsigned long)p[1]<<8) | ((unsigned long)p[2]<<16) | ((unsigned long)p[3]<<24);
+}
+
+unsigned int get_u16(unsigned char * p)
+{
+	return p[0] | ((unsigned int)p[1]<<8);
+}
+
+void print_frame(unsigned char id, unsigned long t, unsigned char * p, unsigned char len)
+{
+	double t_us;
+
+	// The tick rate can change along the way (clock_set() on the robot)
+	t_us=base_us+(((t-base_t)&0xffffffffUL)*1.0e6)/tick_hz;
+
+	switch(id)
+	{
+		case TLM_ID_CLOCK:
+			if(len<4) break;
+			if(get_u32(p)==0) break;
+			base_t=t;
+			base_us=t_us;
+			tick_hz=get_u32(p);
+			printf("%.1f,clock,%lu,\n", t_us, tick_hz);
+		break;
+		case TLM_ID_EDGE:
+			if(len<4) break;
+			printf("%.1f,edge,%u,%u\n", t_us, get_u16(&p[0]), get_u16(&p[2]));
+		break;
+		case TLM_ID_PERIOD:
+			if(len<4) break;
+			printf("%.1f,period,%lu,\n", t_us, get_u32(p));
+		break;
+		case TLM_ID_COINS:
+			if(len<2) break;
+			printf("%.1f,coins,%u,\n", t_us, get_u16(p));
+		break;
+		case TLM_ID_EVENT:
+			if(len<1) break;
+			printf("%.1f,event,%u,\n", t_us, p[0]);
+		break;
+		default:
+			printf("%.1f,unknown_%02x,%u,\n", t_us, id, len);
+		break;
+	}
+}
+
+// Reads bytes into frame[] until there are 'n' of them.  0 at the end of the input.
+int fill(unsigned char * frame, int * have, int n)
+{
+	int c;
+
+	while(*have<n)
+	{
+		if((c=get_byte())<0) return 0;
+		frame[(*have)++]=c;
+	}
+	return 1;
+}
+
+void decode(void)
+{
+	unsigned char frame[TLM_HEADER_LEN+TLM_MAX_PAYLOAD+TLM_CRC_LEN];
+	unsigned char len;
+	unsigned short crc, rx_crc;
+	int c, j, n, have=0; // Bytes in frame[], the first one is always a SYNC
+	int next;            // Where the next frame can start in frame[]
+
+	printf("time_us,message,value1,value2\n");
+	while(1)
+	{
+		// Hunt for the sync byte
+		while(have==0)
+		{
+			if((c=get_byte())<0) return;
+			if(c==TLM_SYNC) frame[have++]=c;
+		}
+
+		// ID and LEN, then the rest of the frame
+		if(!fill(frame, &have, 3)) return;
+		len=frame[2];
+		next=1;
+		if(len<=TLM_MAX_PAYLOAD)
+		{
+			n=TLM_HEADER_LEN+len+TLM_CRC_LEN;
+			if(!fill(frame, &have, n)) return;
+
+			crc=0;
+			for(j=1; j<TLM_HEADER_LEN+len; j++) crc=crc16_ccitt(frame[j], crc);
+			rx_crc=(frame[n-2]*0x100)+frame[n-1];
+			if(crc==rx_crc)
+			{
+				frames++;
+				print_frame(frame[1], get_u32(&frame[3]), &frame[TLM_HEADER_LEN], len);
+				fflush(stdout);
+				next=n;
+			}
+			else crc_errors++;
+		}
+
+		// If that was not a frame, the SYNC was part of some other data and a
+		// real frame can start in the bytes already read: look for the next
+		// SYNC from frame[1] on instead of dropping them.  After a good frame
+		// the bytes read past its end are kept the same way.
+		for(j=next; (j<have) && (frame[j]!=TLM_SYNC); j++);
+		have-=j;
+		memmove(frame, &frame[j], have);
+	}
+}
+
+void print_help (char * prn)
+{
+	printf("Usage examples:\n");
+	printf("%s -D/dev/ttyUSB0 > run.csv (decode telemetry from the serial port)\n", prn);
+	printf("%s -Fcapture.bin > run.csv (decode telemetry from a raw capture file)\n", prn);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	int j;
+
+	for(j=1; j<argc; j++)
+	{
+		if(strcmp("-?", argv[j])==0) { print_help(argv[0]); exit(0); }
+		else if((argv[j][0]=='-') && (toupper(argv[j][1])=='D')) strcpy(SerialPort, &argv[j][2]);
+		else if((argv[j][0]=='-') && (toupper(argv[j][1])=='F')) strcpy(InName, &argv[j][2]);
+	}
+
+	if(strlen(InName)>0)
+	{
+		fd=open(InName, O_RDONLY);
+		if(fd<0)
+		{
+			perror(InName);
+			return 1;
+		}
+	}
+	else if(strlen(SerialPort)>0)
+	{
+		if(OpenSerialPort(SerialPort)) return 1;
+	}
+	else
+	{
+		print_help(argv[0]);
+		return 1;
+	}
+
+	decode();
+	close(fd);
+
+	fprintf(stderr, "%lu frames decoded, %lu CRC errors\n", frames, crc_errors);
+	return 0;
+}
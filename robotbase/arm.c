@@ -0,0 +1,106 @@
+// arm.c:  Background servo sequences for the coin picking arm.  See arm.h.
+
+#include "arm.h"
+#include "traj.h"
+
+// Speed and acceleration limits of the moves, in servo counts per second
+#define FAST_VEL   600 // About 90 degrees in 0.2s, the servos cannot go much faster
+#define FAST_ACC  7500
+#define GENTLE_VEL 400 // Coming down on the coin and carrying it
+#define GENTLE_ACC 4000
+
+#define FAST   0
+#define GENTLE 1
+
+typedef struct {
+	int pwm1, pwm2; // Pose to reach
+	int profile;    // How to get there
+} ARM_KEY;
+
+static const long int prof_vel[]={TRAJ_VEL(FAST_VEL), TRAJ_VEL(GENTLE_VEL)};
+static const long int prof_acc[]={TRAJ_ACC(FAST_ACC), TRAJ_ACC(GENTLE_ACC)};
+
+// The poses of the old MoveArm() and ArmInit().  The slow slews used to be
+// one count every 6ms, the other moves were jumps followed by waitms(500).
+static const ARM_KEY seq_home[]={{150, 100, FAST}, {150, 60, FAST}};
+static const ARM_KEY seq_prepare[]={{150, 250, FAST}, {230, 250, FAST}, {170, 250, FAST}};
+static const ARM_KEY seq_lower[]={{170, 100, GENTLE}};
+static const ARM_KEY seq_bin[]={{100, 100, GENTLE}};
+
+static const ARM_KEY * const seq[]={seq_home, seq_prepare, seq_lower, seq_bin};
+static const int seq_len[]={
+	sizeof(seq_home)/sizeof(ARM_KEY),
+	sizeof(seq_prepare)/sizeof(ARM_KEY),
+	sizeof(seq_lower)/sizeof(ARM_KEY),
+	sizeof(seq_bin)/sizeof(ARM_KEY)
+};
+
+static TRAJ servo[2];
+static volatile int pwm[2];
+static const ARM_KEY * keys;
+static volatile int nkeys, key;
+static int at_home;
+
+static void start_key(void)
+{
+	const ARM_KEY * k=&keys[key];
+
+	traj_go(&servo[0], k->pwm1, prof_vel[k->profile], prof_acc[k->profile]);
+	traj_go(&servo[1], k->pwm2, prof_vel[k->profile], prof_acc[k->profile]);
+}
+
+void arm_init(void)
+{
+	nkeys=0;
+	traj_init(&servo[0], seq_home[seq_len[ARM_HOME]-1].pwm1);
+	traj_init(&servo[1], seq_home[seq_len[ARM_HOME]-1].pwm2);
+	pwm[0]=traj_pos(&servo[0]);
+	pwm[1]=traj_pos(&servo[1]);
+	at_home=1;
+}
+
+// Called outside the servo interrupt: the interrupt does not preempt itself,
+// but this can be interrupted by it, so the move is armed last.
+void arm_move(int move)
+{
+	nkeys=0;
+	keys=seq[move];
+	key=0;
+	at_home=0;
+	start_key();
+	nkeys=seq_len[move];
+	if(move==ARM_HOME) at_home=1;
+}
+
+int arm_busy(void)
+{
+	return nkeys!=0;
+}
+
+int arm_idle(void)
+{
+	return (nkeys==0) && at_home;
+}
+
+int arm_pwm(int servo_num)
+{
+	return pwm[servo_num&1];
+}
+
+void arm_frame(void)
+{
+	int moving;
+
+	if(nkeys==0) return;
+
+	moving=traj_frame(&servo[0]);
+	moving|=traj_frame(&servo[1]);
+	pwm[0]=traj_pos(&servo[0]);
+	pwm[1]=traj_pos(&servo[1]);
+	if(!moving)
+	{
+		key++;
+		if(key>=nkeys) nkeys=0;
+		else start_key();
+	}
+}
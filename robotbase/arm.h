@@ -0,0 +1,33 @@
+// arm.h:  Motion sequences for the two servo coin picking arm.
+//
+// MoveArm() and ArmInit() used to jump the servos from pose to pose with a
+// waitms(500) after each jump and slew some joints one count every 6ms, all
+// while the rest of the robot waited.  Here each move is a list of poses, and
+// the servo setpoints follow trapezoidal speed profiles (traj.c) towards the
+// next pose, advanced once per 20ms servo frame by arm_frame(), called from
+// the servo timer interrupt.  Moves run in the background, so the arm can get
+// ready while the robot is still backing up and turning towards the coin.
+//
+// Servo positions are in timer 1 interrupts (10us), so 150 is a 1.5ms pulse.
+// Servo 1 (RB15) swings the arm, servo 2 (RB14) raises and lowers it.  The
+// code is hardware free so Robot_Sim.c runs the same sequences.
+
+#ifndef ARM_H
+#define ARM_H
+
+#define ARM_FRAME_MS 20 // One servo frame
+
+// Moves for arm_move()
+#define ARM_HOME    0 // Resting pose, the servo pulses can be stopped there
+#define ARM_PREPARE 1 // Up and over the coin, ready to come down
+#define ARM_LOWER   2 // Magnet down on the coin
+#define ARM_BIN     3 // Up and over the coin bin
+
+void arm_init(void);         // Setpoints to the home pose, no motion
+void arm_move(int move);     // Start a move from wherever the arm is now
+int  arm_busy(void);
+int  arm_idle(void);         // Not moving and at home: the servos can be switched off
+int  arm_pwm(int servo);     // Current setpoint of servo 0 or 1
+void arm_frame(void);        // Call once per servo frame
+
+#endif
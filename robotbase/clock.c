@@ -0,0 +1,59 @@
+// clock.c:  Switch between the clock profiles.  See clock.h.
+
+#include <XC.h>
+#include "clock.h"
+#include "motor.h"
+#include "freq_counter.h"
+#include "telemetry.h"
+
+typedef struct {
+	unsigned long hz;
+	unsigned int pllodiv; // OSCCON PLLODIV code for the 80MHz PLL output
+} CLOCK_PROFILE;
+
+static const CLOCK_PROFILE profiles[]={
+	{40000000L, 1}, // PLL / 2
+	{10000000L, 3}  // PLL / 8
+};
+
+static volatile unsigned long hz_now=CLOCK_FAST_HZ;
+static int profile_now=CLOCK_FAST;
+
+void clock_set(int profile)
+{
+	unsigned int status;
+
+	if(profile==profile_now) return;
+
+	// A byte going out of the UART would be garbled by the baud rate change
+	while(!U2STAbits.TRMT);
+
+	status=__builtin_disable_interrupts();
+
+	SYSKEY = 0;
+	SYSKEY = 0xAA996655; // Unlock OSCCON
+	SYSKEY = 0x556699AA;
+	OSCCONbits.PLLODIV = profiles[profile].pllodiv;
+	SYSKEY = 0x33333333; // Lock it again
+
+	hz_now=profiles[profile].hz;
+	profile_now=profile;
+	clock_changed(hz_now);
+	motor_clock(hz_now);
+	fc_clock(hz_now);
+	tlm_clock(hz_now);
+
+	if(status&1) __builtin_enable_interrupts();
+
+	tlm_send_clock(); // Too slow to send with interrupts off
+}
+
+int clock_profile(void)
+{
+	return profile_now;
+}
+
+unsigned long clock_hz(void)
+{
+	return hz_now;
+}
@@ -0,0 +1,35 @@
+// clock.h:  Run time clock profiles.
+//
+// The configuration bits start the PIC32 at 40MHz (8MHz FRC / 2 * 20 / 2) with
+// PBCLK = SYSCLK, and the code used to assume that clock everywhere.  That is
+// wasted power whenever the robot is just sitting there, so clock_set() can
+// drop the PLL output divider to run at 10MHz and go back up again.  With
+// interrupts off it changes the clock and has every module that depends on it
+// recalculate its settings, so nothing ever runs with half updated values:
+//
+//   UART2 baud rate and timer 1 (servo) period   clock_changed() in the main program
+//   Timer 3 PWM period and the wheel duties      motor_clock()
+//   Frequency counter units                      fc_clock()
+//   Telemetry timestamp rate                     tlm_clock(), 156250Hz either way
+//   Delays                                       delay.c reads clock_hz()
+//
+// The servo interrupt runs every 10us and needs the fast clock, so only slow
+// down while the arm is home and the servo timer is stopped.
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#define CLOCK_FAST 0 // 40MHz, the reset clock
+#define CLOCK_SLOW 1 // 10MHz
+
+#define CLOCK_FAST_HZ 40000000L
+
+void clock_set(int profile);
+int  clock_profile(void);
+unsigned long clock_hz(void); // SYSCLK, which is also PBCLK
+
+// Provided by the main program for its own peripherals.  Called by clock_set()
+// with interrupts disabled.
+void clock_changed(unsigned long hz);
+
+#endif
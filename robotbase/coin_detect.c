@@ -0,0 +1,90 @@
+// coin_detect.c:  Adaptive baseline coin detector.  See coin_detect.h.
+
+#include "coin_detect.h"
+
+static long int baseline_q4;  // Baseline period with 4 fractional bits
+static long int learn_sum;
+static int learn_count;
+static int coin_state;
+static int confirm_count;
+
+// Returns baseline*permille/1000 without overflowing 32 bits
+static long int permille_of(long int baseline, int permille)
+{
+	return (baseline/1000)*permille + ((baseline%1000)*permille)/1000;
+}
+
+void coin_init(void)
+{
+	baseline_q4=0;
+	learn_sum=0;
+	learn_count=0;
+	coin_state=0;
+	confirm_count=0;
+}
+
+// Returns 1 while the robot is still learning the no-coin baseline
+int coin_learning(void)
+{
+	return learn_count<COIN_LEARN_SAMPLES;
+}
+
+long int coin_baseline(void)
+{
+	return baseline_q4>>4;
+}
+
+// Feed one period measurement.  Returns 1 if a coin is under the detector.
+// A period of zero (fc_measure() timed out) is ignored.
+int coin_update(long int period)
+{
+	long int baseline, dev;
+
+	if(period<=0) return coin_state;
+
+	// Startup: average the first measurements to get the baseline.  The coil
+	// must be away from coins while this happens.
+	if(coin_learning())
+	{
+		learn_sum+=period;
+		learn_count++;
+		if(learn_count==COIN_LEARN_SAMPLES)
+		{
+			baseline_q4=(learn_sum<<4)/COIN_LEARN_SAMPLES;
+		}
+		return 0;
+	}
+
+	baseline=baseline_q4>>4;
+	dev=period-baseline;
+	if(dev<0) dev=-dev; // Ferrous and non-ferrous coins shift the period in opposite directions
+
+	if(coin_state==0)
+	{
+		if(dev>permille_of(baseline, COIN_ON_PERMILLE))
+		{
+			confirm_count++;
+			if(confirm_count>=COIN_CONFIRM) coin_state=1;
+		}
+		else
+		{
+			confirm_count=0;
+			// Only track the baseline while there is clearly no coin, so a coin
+			// sitting under the coil is never learned as the new baseline.
+			if(dev<=permille_of(baseline, COIN_OFF_PERMILLE))
+			{
+				baseline_q4+=((period<<4)-baseline_q4)>>COIN_EMA_SHIFT;
+			}
+		}
+	}
+	else
+	{
+		if(dev<=permille_of(baseline, COIN_OFF_PERMILLE))
+		{
+			coin_state=0;
+			confirm_count=0;
+		}
+	}
+
+	return coin_state;
+}
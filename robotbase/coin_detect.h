@@ -0,0 +1,26 @@
+// coin_detect.h:  Self calibrating coin detector.  Instead of comparing the
+// period of the metal detector oscillator against a fixed number, the
+// detector learns the no-coin period at startup and then follows its slow
+// drift (temperature, battery) with an exponential moving average.  A coin is
+// declared when the period moves away from that baseline by more than
+// COIN_ON_PERMILLE and released when it comes back within COIN_OFF_PERMILLE.
+//
+// The code is integer only and does not touch the hardware, so the caller
+// passes in the measured periods (in any time unit, as long as it is always
+// the same one).
+
+#ifndef COIN_DETECT_H
+#define COIN_DETECT_H
+
+#define COIN_LEARN_SAMPLES 16 // Measurements averaged at startup for the baseline
+#define COIN_EMA_SHIFT     5  // Baseline tracking: alpha = 1/32
+#define COIN_ON_PERMILLE   15 // Shift from baseline that declares a coin (1.5%)
+#define COIN_OFF_PERMILLE  8  // Shift from baseline that releases it (0.8%)
+#define COIN_CONFIRM       2  // Consecutive measurements needed to declare a coin
+
+void coin_init(void);
+int  coin_update(long int period);
+int  coin_learning(void);
+long int coin_baseline(void);
+
+#endif
@@ -0,0 +1,73 @@
+// delay.c:  Core timer delays that keep the CPU in IDLE mode.  See delay.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "delay.h"
+#include "clock.h"
+
+// The core timer runs at SYSCLK/2, whatever clock_set() made SYSCLK
+#define TICKS_PER_MS (clock_hz()/2000L)
+#define RETRY_TICKS (clock_hz()/100000L) // 20us
+
+static volatile unsigned char expired;
+
+// 'wait' is a MIPS32 instruction, so the functions that use it cannot be
+// compiled as mips16 code like the rest of the project.
+#define NOMIPS16 __attribute__((nomips16))
+
+// The delay could see 'expired' still clear, get this interrupt, and only
+// then execute 'wait'.  So instead of firing once this keeps coming back every
+// RETRY_TICKS until the delay is over and turns it off: in the worst case the
+// delay is 20us late instead of asleep for good.  Writing the compare register
+// also clears the core timer interrupt request.
+void __ISR(_CORE_TIMER_VECTOR, IPL2SOFT) CoreTimer_Handler(void)
+{
+	expired=1;
+	_CP0_SET_COMPARE(_CP0_GET_COUNT()+RETRY_TICKS);
+	IFS0CLR=_IFS0_CTIF_MASK;
+}
+
+void delay_init(void)
+{
+	IEC0CLR=_IEC0_CTIE_MASK;
+	IPC0bits.CTIP=2;
+	IPC0bits.CTIS=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	OSCCONCLR=_OSCCON_SLPEN_MASK; // 'wait' goes to IDLE, not SLEEP, so the peripherals keep running
+	INTCONbits.MVEC=1;
+}
+
+static int interrupts_on(void)
+{
+	return (_CP0_GET_STATUS()&1)!=0; // Status.IE
+}
+
+void NOMIPS16 delay_ticks(unsigned long ticks)
+{
+	unsigned long start=_CP0_GET_COUNT();
+
+	if((ticks<DELAY_MIN_SLEEP) || !interrupts_on())
+	{
+		while((_CP0_GET_COUNT()-start)<ticks);
+		return;
+	}
+
+	expired=0;
+	IFS0CLR=_IFS0_CTIF_MASK;
+	_CP0_SET_COMPARE(start+ticks);
+	IEC0SET=_IEC0_CTIE_MASK;
+	// The time check covers an interrupt between reading the count and writing
+	// the compare register that made us miss the deadline.
+	while(!expired && ((_CP0_GET_COUNT()-start)<ticks)) asm volatile("wait");
+	IEC0CLR=_IEC0_CTIE_MASK;
+}
+
+void delay_ms(int ms)
+{
+	if(ms>0) delay_ticks((unsigned long)ms*TICKS_PER_MS);
+}
+
+void NOMIPS16 delay_idle(void)
+{
+	if(interrupts_on()) asm volatile("wait");
+}
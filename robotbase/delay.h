@@ -0,0 +1,26 @@
+// delay.h:  Delays that sleep instead of spinning.
+//
+// wait_1ms() used to reset the core timer and spin on it, so the CPU ran flat
+// out at 40MHz for every LCD command, every turn and every pause.  Here a
+// delay sets the core timer compare register to the end of the delay and
+// puts the CPU in IDLE mode with the 'wait' instruction.  Any interrupt wakes
+// it up (the servo, motor and encoder interrupts keep running as before) and
+// it goes back to sleep until the core timer interrupt says the time is up.
+// The core timer is never reset, so the delays no longer disturb anybody else
+// using it and a long delay is one deadline instead of a chain of 1ms waits
+// that each lose a little time.
+//
+// The core timer counts at SYSCLK/2 (see clock.h).  Delays shorter than
+// DELAY_MIN_SLEEP, or with interrupts disabled, spin like before.
+
+#ifndef DELAY_H
+#define DELAY_H
+
+#define DELAY_MIN_SLEEP 200 // Core timer ticks (10us at 40MHz): not worth going to sleep
+
+void delay_init(void);                // Call before enabling interrupts
+void delay_ticks(unsigned long ticks);
+void delay_ms(int ms);
+void delay_idle(void);                // Sleep until the next interrupt, for polling loops
+
+#endif
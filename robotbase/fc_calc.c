@@ -0,0 +1,75 @@
+// fc_calc.c:  The arithmetic of the reciprocal frequency counter.  No
+// hardware here, see freq_counter.h.
+
+#include "freq_counter.h"
+
+// Timer 2 is 16 bits and its overflow interrupt counts the upper half in
+// 'high'.  'low' is TMR2, read before T2IF: with the flag set the timer rolled
+// over and the interrupt has not run yet, unless the roll over came after
+// 'low' was read (then 'low' is still large).  The masks keep 32-bit wrap
+// around on a 64-bit PC.
+unsigned long fc_time(unsigned int high, unsigned int low, int t2if)
+{
+	if(t2if && (low<0x8000)) high++;
+	return (((unsigned long)high<<16)|(low&0xffff))&0xffffffffUL;
+}
+
+// A capture is from before 'now' (fc_time() in the capture interrupt), by
+// less than one timer 2 period.  Working back from 'now' does not care
+// whether the overflow interrupt ran between the capture and here, which
+// happens when both are pending: timer 2 has the higher natural priority.
+unsigned long fc_extend(unsigned long now, unsigned int c)
+{
+	return (now-((now-c)&0xffff))&0xffffffffUL;
+}
+
+void fc_gate_start(volatile FC_GATE * g, unsigned long gate)
+{
+	g->gate=gate;
+	g->captures=0;
+	g->done=0;
+	g->running=1;
+}
+
+int fc_gate_put(volatile FC_GATE * g, unsigned long t)
+{
+	if(!g->running) return g->done;
+	if(g->captures==0)
+	{
+		g->t_first=t;
+	}
+	else
+	{
+		g->t_last=t;
+		if(((g->t_last-g->t_first)&0xffffffffUL)>=g->gate)
+		{
+			g->running=0;
+			g->done=1;
+		}
+	}
+	g->captures++;
+	return g->done;
+}
+
+// Period in FC_PBCLK ticks with 4 fractional bits, 0 if not done.  'scale' is
+// FC_PBCLK ticks per timer 2 tick.
+long int fc_gate_period_q4(volatile FC_GATE * g, unsigned long scale)
+{
+	unsigned long edges;
+
+	if(!g->done) return 0;
+	edges=(g->captures-1)*FC_EDGES_PER_CAPTURE;
+	return ((((g->t_last-g->t_first)&0xffffffffUL)*scale)<<4)/edges;
+}
+
+// Frequency in Hz, 0 if not done
+unsigned long fc_gate_frequency(volatile FC_GATE * g, unsigned long scale)
+{
+	unsigned long long edges;
+	unsigned long dt;
+
+	if(!g->done) return 0;
+	edges=(unsigned long long)(g->captures-1)*FC_EDGES_PER_CAPTURE;
+	dt=(g->t_last-g->t_first)&0xffffffffUL;
+	return (edges*(FC_PBCLK/scale)+dt/2)/dt;
+}
@@ -0,0 +1,161 @@
+// filter.c:  Integer filters for ADC readings.  See filter.h.
+
+#include "filter.h"
+
+int filt_round(long x, int bits)
+{
+	if(bits<=0) return (int)x;
+	return (int)((x+(1L<<(bits-1)))>>bits);
+}
+
+void filt_os_init(FILT_OS * f, int bits)
+{
+	if(bits<0) bits=0;
+	if(bits>6) bits=6; // 4096 samples of 10 bits still fit in the sum
+	f->bits=bits;
+	f->n=1U<<(2*bits);
+	f->sum=0;
+	f->count=0;
+	f->out=0;
+}
+
+int filt_os_put(FILT_OS * f, int x)
+{
+	f->sum+=x;
+	if(++f->count<f->n) return 0;
+	f->out=f->sum>>f->bits; // Decimate: n samples in, one out
+	f->sum=0;
+	f->count=0;
+	return 1;
+}
+
+void filt_iir_init(FILT_IIR * f, int shift)
+{
+	f->shift=shift;
+	f->acc=0;
+	f->primed=0;
+}
+
+int filt_iir_put(FILT_IIR * f, int x)
+{
+	// Start at the first sample instead of crawling up from zero
+	if(!f->primed)
+	{
+		f->acc=(long)x<<f->shift;
+		f->primed=1;
+	}
+	else
+	{
+		f->acc+=x-(f->acc>>f->shift);
+	}
+	return filt_round(f->acc, f->shift);
+}
+
+void filt_ma_init(FILT_MA * f, int len)
+{
+	if(len<1) len=1;
+	if(len>FILT_MA_MAX) len=FILT_MA_MAX;
+	f->len=len;
+	f->pos=0;
+	f->count=0;
+	f->sum=0;
+}
+
+// Until 'len' samples are in it averages the ones it has
+int filt_ma_put(FILT_MA * f, int x)
+{
+	if(f->count==f->len) f->sum-=f->buf[f->pos];
+	else f->count++;
+	f->buf[f->pos]=x;
+	f->sum+=x;
+	if(++f->pos>=f->len) f->pos=0;
+	return (int)((f->sum+f->count/2)/f->count);
+}
+
+void filt_med_init(FILT_MED * f, int len)
+{
+	if(len<1) len=1;
+	if(len>FILT_MED_MAX) len=FILT_MED_MAX;
+	f->len=len;
+	f->pos=0;
+	f->count=0;
+}
+
+int filt_median3(int a, int b, int c)
+{
+	if(a>b)
+	{
+		if(b>c) return b;
+		return (a>c)?c:a;
+	}
+	if(a>c) return a;
+	return (b>c)?c:b;
+}
+
+// Insertion sort of a copy: at most FILT_MED_MAX samples
+int filt_med_put(FILT_MED * f, int x)
+{
+	int s[FILT_MED_MAX], v;
+	int i, j;
+
+	f->buf[f->pos]=x;
+	if(++f->pos>=f->len) f->pos=0;
+	if(f->count<f->len) f->count++;
+
+	if(f->count==3) return filt_median3(f->buf[0], f->buf[1], f->buf[2]);
+	for(i=0; i<f->count; i++)
+	{
+		v=f->buf[i];
+		for(j=i; (j>0) && (s[j-1]>v); j--) s[j]=s[j-1];
+		s[j]=v;
+	}
+	return s[f->count/2];
+}
+
+void filt_iq_init(FILT_IQ * f, int cycles)
+{
+	if(cycles<1) cycles=1;
+	if(cycles>FILT_IQ_MAX) cycles=FILT_IQ_MAX;
+	f->cycles=cycles;
+	f->i=f->q=0;
+	f->phase=0;
+	f->n=0;
+	f->out=0;
+}
+
+// A tone of peak amplitude A adds 2A to the length of (i, q) every cycle
+int filt_iq_put(FILT_IQ * f, int x)
+{
+	switch(f->phase)
+	{
+		case 0: f->i+=x; break;
+		case 1: f->q+=x; break;
+		case 2: f->i-=x; break;
+		default: f->q-=x; break;
+	}
+	f->phase=(f->phase+1)&3;
+	if((f->phase!=0) || (++f->n<f->cycles)) return 0;
+	f->out=(filt_isqrt((unsigned long)(f->i*f->i)+(unsigned long)(f->q*f->q))+f->cycles/2)/f->cycles;
+	f->i=f->q=0;
+	f->n=0;
+	return 1;
+}
+
+// One result bit per pass, rounded down
+unsigned int filt_isqrt(unsigned long x)
+{
+	unsigned long r=0, b=1UL<<30;
+
+	while(b>x) b>>=2;
+	while(b)
+	{
+		if(x>=r+b)
+		{
+			x-=r+b;
+			r=(r>>1)+b;
+		}
+		else r>>=1;
+		b>>=2;
+	}
+	return (unsigned int)r;
+}
@@ -0,0 +1,74 @@
+// filter.h:  Integer filters for ADC readings.  No tables, no floating
+// point, no hardware: the caller feeds the samples one at a time, so the
+// same filters work on ADCRead(), on the MCP3008 and in Robot_Sim.c.
+//
+//   - Oversampling: 4^bits samples added up and divided by 2^bits give
+//     'bits' more bits of resolution, as long as there is at least 1 count
+//     of noise to dither the input.  Averages the noise down too.
+//   - First order IIR (exponential average): y += (x-y)/2^shift, with
+//     'shift' fractional bits kept so small steps are not lost.
+//   - Moving average of the last N samples, with a running sum.
+//   - Median of the last N samples: removes spikes (motor noise) without
+//     the smearing of an average.
+//   - Quadrature detector: the amplitude of a tone sampled at exactly 4
+//     times its frequency (or aliased there).  The samples are multiplied by
+//     1, 0, -1, 0 and 0, 1, 0, -1, which is a Goertzel filter at Fs/4 with
+//     no multiplications, so any DC offset cancels and the phase of the tone
+//     does not matter.
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#define FILT_MA_MAX  16
+#define FILT_MED_MAX 9
+#define FILT_IQ_MAX  32 // Cycles: (32*1023)^2 twice still fits in 32 bits
+
+typedef struct {
+	long sum;
+	unsigned int count, n;
+	unsigned char bits;
+	long out;        // Last result, 'bits' more bits than the input
+} FILT_OS;
+
+typedef struct {
+	long acc;        // Output with 'shift' fractional bits
+	unsigned char shift, primed;
+} FILT_IIR;
+
+typedef struct {
+	int buf[FILT_MA_MAX];
+	long sum;
+	unsigned char len, pos, count;
+} FILT_MA;
+
+typedef struct {
+	int buf[FILT_MED_MAX];
+	unsigned char len, pos, count;
+} FILT_MED;
+
+typedef struct {
+	long i, q;
+	unsigned char phase, cycles, n;
+	int out;         // Last result, peak to peak amplitude in input units
+} FILT_IQ;
+
+void filt_os_init(FILT_OS * f, int bits);
+int  filt_os_put(FILT_OS * f, int x); // 1 when f->out is new, every 4^bits samples
+
+void filt_iir_init(FILT_IIR * f, int shift);
+int  filt_iir_put(FILT_IIR * f, int x);
+
+void filt_ma_init(FILT_MA * f, int len);
+int  filt_ma_put(FILT_MA * f, int x);
+
+void filt_med_init(FILT_MED * f, int len); // Odd lengths give a true median
+int  filt_med_put(FILT_MED * f, int x);
+int  filt_median3(int a, int b, int c);
+
+void filt_iq_init(FILT_IQ * f, int cycles);
+int  filt_iq_put(FILT_IQ * f, int x); // 1 when f->out is new, every 4*cycles samples
+
+int  filt_round(long x, int bits); // x/2^bits, rounded
+unsigned int filt_isqrt(unsigned long x);
+
+#endif
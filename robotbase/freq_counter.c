@@ -0,0 +1,130 @@
+// freq_counter.c:  Reciprocal frequency counter using input capture 3 and
+// timer 2.  See freq_counter.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "freq_counter.h"
+#include "delay.h"
+
+static volatile unsigned int t2_high;  // Timer 2 overflows, upper half of the 32-bit time
+static volatile FC_GATE fc;
+static unsigned long scale=1; // FC_PBCLK ticks per timer 2 tick
+
+// Timer 2 only extends itself to 32 bits.  It has the same priority as the
+// capture interrupt so neither can preempt the other.
+void __ISR(_TIMER_2_VECTOR, IPL4SOFT) Timer2_Handler(void)
+{
+	IFS0CLR=_IFS0_T2IF_MASK;
+	t2_high++;
+}
+
+void __ISR(_INPUT_CAPTURE_3_VECTOR, IPL4SOFT) IC3_Handler(void)
+{
+	unsigned int c, low;
+	unsigned long now;
+
+	while(IC3CONbits.ICBNE)
+	{
+		c=IC3BUF;
+		low=TMR2; // Before T2IF, see fc_time()
+		now=fc_time(t2_high, low, IFS0bits.T2IF);
+		fc_gate_put(&fc, fc_extend(now, c));
+	}
+	IFS0CLR=_IFS0_IC3IF_MASK;
+}
+
+void fc_init(void)
+{
+	// RB5 is already a digital input with pull-up (see ConfigurePins())
+	IC3Rbits.IC3R = 1; // IC3 input on RPB5
+
+	T2CON = 0;
+	TMR2 = 0;
+	PR2 = 0xffff;
+	T2CONbits.TCKPS = 0; // 1:1 prescale, timer 2 runs at PBCLK
+	IPC2bits.T2IP = 4;
+	IPC2bits.T2IS = 0;
+	IFS0bits.T2IF = 0;
+	IEC0bits.T2IE = 1;
+	T2CONbits.ON = 1;
+
+	IC3CON = 0;
+	IC3CONbits.ICTMR = 1; // Capture timer 2
+	IC3CONbits.ICI = 0;   // Interrupt on every capture
+	IC3CONbits.ICM = FC_ICM;
+	IPC3bits.IC3IP = 4;
+	IPC3bits.IC3IS = 0;
+	IFS0bits.IC3IF = 0;
+	IEC0bits.IC3IE = 1;
+	IC3CONbits.ON = 1;
+
+	INTCONbits.MVEC = 1; //Int multi-vector
+}
+
+// Current 32-bit time in FC_PBCLK ticks
+unsigned long fc_now(void)
+{
+	unsigned int high, low;
+
+	do
+	{
+		high=t2_high;
+		low=TMR2;
+	} while(high!=t2_high);
+	return (((unsigned long)high<<16)|low)*scale;
+}
+
+void fc_start(unsigned long gate_ticks)
+{
+	IEC0bits.IC3IE = 0;
+	while(IC3CONbits.ICBNE) (void)IC3BUF; // Discard old captures
+	fc_gate_start(&fc, gate_ticks/scale);
+	IEC0bits.IC3IE = 1;
+}
+
+int fc_done(void)
+{
+	return fc.done;
+}
+
+// Period of the input in FC_PBCLK ticks with 4 fractional bits, 0 if not done
+long int fc_period_q4(void)
+{
+	return fc_gate_period_q4(&fc, scale);
+}
+
+// Frequency of the input in Hz, 0 if not done
+unsigned long fc_frequency(void)
+{
+	return fc_gate_frequency(&fc, scale);
+}
+
+// Measure for one gate time and return fc_period_q4(), or 0 if the
+// oscillator is not running (timeout at four gate times plus 25ms).
+long int fc_measure(unsigned long gate_ticks)
+{
+	unsigned long start;
+
+	fc_start(gate_ticks);
+	start=fc_now();
+	while(!fc_done())
+	{
+		if((fc_now()-start)>(gate_ticks*4+FC_GATE_US(25000)))
+		{
+			fc.running=0;
+			return 0;
+		}
+		delay_idle(); // Woken by the next capture or timer 2 overflow
+	}
+	return fc_period_q4();
+}
+
+// A measurement running across the change would mix two clocks, so it is
+// dropped and fc_measure() times out with 0, which coin_detect.c ignores.
+void fc_clock(unsigned long pbclk)
+{
+	fc.running=0;
+	fc.done=0;
+	scale=FC_PBCLK/pbclk;
+	if(scale<1) scale=1;
+}
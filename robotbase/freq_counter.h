@@ -0,0 +1,62 @@
+// freq_counter.h:  Reciprocal frequency counter for the metal detector
+// oscillator on RB5 (pin 14).  GetPeriod() needed many whole periods to get
+// a good resolution and kept the CPU polling the pin the whole time.  Here
+// the input capture module 3 counts the input edges in hardware (one capture
+// every FC_EDGES_PER_CAPTURE rising edges) and timestamps them with timer 2
+// running at PBCLK.  After a fixed gate time the period is the time between
+// the first and last capture divided by the number of edges in between, so
+// the resolution is one PBCLK tick over the whole gate, whatever the input
+// frequency.
+//
+// Times and periods are always in ticks of FC_PBCLK, the 40MHz clock, so the
+// coin detector baseline stays good when clock_set() slows PBCLK down (with
+// less resolution).
+//
+// The arithmetic (32-bit capture times, the gate and the period) is in
+// fc_calc.c, which does not touch the hardware, so Freq_Counter_Test.c can
+// replay recorded edge times through it on a PC.
+
+#ifndef FREQ_COUNTER_H
+#define FREQ_COUNTER_H
+
+// Input capture mode: 3=every rising edge, 4=every 4th, 5=every 16th
+#define FC_ICM 5
+#if FC_ICM==5
+	#define FC_EDGES_PER_CAPTURE 16
+#elif FC_ICM==4
+	#define FC_EDGES_PER_CAPTURE 4
+#else
+	#define FC_EDGES_PER_CAPTURE 1
+#endif
+
+#define FC_PBCLK 40000000L
+#define FC_GATE_US(us) ((unsigned long)((FC_PBCLK/1000000L)*(us)))
+#define FC_GATE_DEFAULT FC_GATE_US(2000) // 2ms gate time
+
+// One gate time of captures, all times in timer 2 ticks
+typedef struct {
+	unsigned long gate;
+	unsigned long t_first, t_last;
+	unsigned long captures;
+	unsigned char running, done;
+} FC_GATE;
+
+// fc_calc.c
+unsigned long fc_time(unsigned int high, unsigned int low, int t2if); // 32-bit time from timer 2
+unsigned long fc_extend(unsigned long now, unsigned int c);           // 32-bit time of a 16-bit capture
+void fc_gate_start(volatile FC_GATE * g, unsigned long gate);
+int  fc_gate_put(volatile FC_GATE * g, unsigned long t); // 1 once the gate is over
+long int fc_gate_period_q4(volatile FC_GATE * g, unsigned long scale);
+unsigned long fc_gate_frequency(volatile FC_GATE * g, unsigned long scale);
+
+// freq_counter.c
+void fc_init(void);
+unsigned long fc_now(void);
+void fc_start(unsigned long gate_ticks);
+int  fc_done(void);
+long int fc_period_q4(void);
+unsigned long fc_frequency(void);
+long int fc_measure(unsigned long gate_ticks);
+void fc_clock(unsigned long pbclk); // New PBCLK, called by clock_set()
+
+#endif
@@ -0,0 +1,160 @@
+// motor.c:  Output compare PWM for the wheel H-bridge.  See motor.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "motor.h"
+#include "clock.h"
+
+#define MOTOR_TICKS_PER_MS (MOTOR_PWM_FREQ/1000L)
+
+static volatile int duty_now[2], duty_target[2];
+static unsigned int ms_div;
+
+// Load one wheel's duty into its output compare module and direction pin
+static void motor_apply(int wheel, int duty)
+{
+	unsigned long full, rs;
+	int forward;
+
+	full=PR3+1;
+	forward=(duty>=0);
+	if(duty<0) duty=-duty;
+	if(duty>MOTOR_MAX) duty=MOTOR_MAX;
+
+	if(wheel==0)
+	{
+		// Forward: RA0 low, RA1 high.  RA0 is the PWM pin.
+		rs=forward?(full*(MOTOR_MAX-duty))/MOTOR_MAX:(full*duty)/MOTOR_MAX;
+		TRISAbits.TRISA1 = forward?1:0;
+		OC1RS = rs;
+	}
+	else
+	{
+		// Forward: RB0 high, RB1 low.  RB0 is the PWM pin.
+		rs=forward?(full*duty)/MOTOR_MAX:(full*(MOTOR_MAX-duty))/MOTOR_MAX;
+		TRISBbits.TRISB1 = forward?0:1;
+		OC3RS = rs;
+	}
+}
+
+void __ISR(_TIMER_3_VECTOR, IPL3SOFT) Timer3_Handler(void)
+{
+	int i;
+
+	IFS0CLR=_IFS0_T3IF_MASK;
+
+	ms_div++;
+	if(ms_div<MOTOR_TICKS_PER_MS) return;
+	ms_div=0;
+
+	for(i=0; i<2; i++)
+	{
+		if(duty_now[i]!=duty_target[i])
+		{
+			if(duty_now[i]<duty_target[i])
+			{
+				duty_now[i]+=MOTOR_RAMP_PER_MS;
+				if(duty_now[i]>duty_target[i]) duty_now[i]=duty_target[i];
+			}
+			else
+			{
+				duty_now[i]-=MOTOR_RAMP_PER_MS;
+				if(duty_now[i]<duty_target[i]) duty_now[i]=duty_target[i];
+			}
+			motor_apply(i, duty_now[i]);
+		}
+	}
+
+	// Nothing left to ramp and no use for the tick: stop waking the CPU
+	// MOTOR_PWM_FREQ times a second.  The PWM keeps running, and motor_set()
+	// turns the interrupt back on.
+	if(!motor_tick() && !duty_target[0] && !duty_target[1] && !duty_now[0] && !duty_now[1])
+	{
+		IEC0CLR=_IEC0_T3IE_MASK;
+	}
+}
+
+void motor_init(void)
+{
+	// PWM pins: open drain outputs, so 'high' lets the bridge pull-up take over
+	ANSELA &= ~(1<<0);
+	ANSELB &= ~(1<<0);
+	ODCAbits.ODCA0 = 1;
+	ODCBbits.ODCB0 = 1;
+	TRISAbits.TRISA0 = 0;
+	TRISBbits.TRISB0 = 0;
+	RPA0Rbits.RPA0R = 0x0005; // OC1 on RA0 (pin 2)
+	RPB0Rbits.RPB0R = 0x0005; // OC3 on RB0 (pin 4)
+
+	// Direction pins: still switched between output-low and input
+	ANSELA &= ~(1<<1);
+	ANSELB &= ~(1<<1);
+	LATAbits.LATA1 = 0;
+	LATBbits.LATB1 = 0;
+
+	T3CON = 0;
+	TMR3 = 0;
+	PR3 = (clock_hz()/MOTOR_PWM_FREQ)-1; // PR = [FPB / (PWM Frequency * TMR Prescale Value)] - 1
+	T3CONbits.TCKPS = 0;
+
+	OC1CON = 0;
+	OC1CONbits.OCTSEL = 1; // Timer 3
+	OC1CONbits.OCM = 6;    // PWM mode, fault pin disabled
+	OC3CON = 0;
+	OC3CONbits.OCTSEL = 1;
+	OC3CONbits.OCM = 6;
+
+	duty_now[0]=duty_now[1]=0;
+	duty_target[0]=duty_target[1]=0;
+	motor_apply(0, 0);
+	motor_apply(1, 0);
+
+	OC1CONbits.ON = 1;
+	OC3CONbits.ON = 1;
+
+	IPC3bits.T3IP = 3;
+	IPC3bits.T3IS = 0;
+	IFS0bits.T3IF = 0;
+	IEC0bits.T3IE = 1;
+	T3CONbits.ON = 1;
+
+	INTCONbits.MVEC = 1; //Int multi-vector
+}
+
+void motor_set(int left, int right)
+{
+	duty_target[0]=left;
+	duty_target[1]=right;
+	IEC0SET=_IEC0_T3IE_MASK;
+}
+
+void motor_set_now(int left, int right)
+{
+	IEC0bits.T3IE = 0;
+	duty_now[0]=duty_target[0]=left;
+	duty_now[1]=duty_target[1]=right;
+	motor_apply(0, left);
+	motor_apply(1, right);
+	IEC0bits.T3IE = 1;
+}
+
+void motor_stop(int how)
+{
+	if(how==MOTOR_COAST) motor_set(0, 0);
+	else motor_set_now(0, 0);
+}
+
+int motor_duty(int wheel)
+{
+	return duty_now[wheel&1];
+}
+
+// Same PWM frequency (and motor_tick() rate) at the new clock.  The duties
+// are scaled to the new period right away.
+void motor_clock(unsigned long pbclk)
+{
+	TMR3 = 0; // Could be past the new, shorter period
+	PR3 = (pbclk/MOTOR_PWM_FREQ)-1;
+	motor_apply(0, duty_now[0]);
+	motor_apply(1, duty_now[1]);
+}
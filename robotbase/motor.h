@@ -0,0 +1,42 @@
+// motor.h:  Hardware PWM driver for the two wheel H-bridge.
+//
+// Each wheel has one PWM input and one direction input on the bridge:
+//
+//   Wheel 1: OC1 on RA0 (pin 2), direction on RA1 (pin 3)
+//   Wheel 2: OC3 on RB0 (pin 4), direction on RB1 (pin 5)
+//
+// The output compare modules run from timer 3, so the PWM needs no CPU time.
+// The bridge inputs are pulled up and were driven by switching the pins
+// between output-low and input.  The PWM pins are set as open drain to keep
+// that behaviour.  During the off part of each PWM period both inputs of a
+// wheel are at the same level, which brakes the motor.  The bridge has no
+// high impedance state, so coasting is done by ramping the duty down.
+//
+// The timer 3 interrupt ramps the duty cycles towards their targets and calls
+// motor_tick() once per millisecond, which must be implemented elsewhere
+// (odometry.c uses it to run the speed control loop).  Once both wheels are
+// stopped and motor_tick() returns 0 the interrupt turns itself off until the
+// next motor_set(); whoever needs the tick again sets IEC0bits.T3IE.
+
+#ifndef MOTOR_H
+#define MOTOR_H
+
+#define MOTOR_PWM_FREQ    20000L // Above the audible range
+#define MOTOR_MAX         1000   // Full scale of the signed duty cycles
+#define MOTOR_RAMP_PER_MS 10     // Zero to full speed in 100ms
+
+#define MOTOR_BRAKE 0
+#define MOTOR_COAST 1
+
+void motor_init(void);
+void motor_set(int left, int right);  // Signed duty, -MOTOR_MAX to MOTOR_MAX, ramped
+void motor_set_now(int left, int right); // Same, without ramping
+void motor_stop(int how);
+int  motor_duty(int wheel);
+void motor_clock(unsigned long pbclk); // New PBCLK, called by clock_set()
+
+/* Called every millisecond from the timer 3 interrupt.  Implement it in your code.
+   Return 1 to keep the tick going while the wheels are stopped. */
+extern int motor_tick(void);
+
+#endif
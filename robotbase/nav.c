@@ -0,0 +1,230 @@
+// nav.c:  Search patterns for the coin collecting robot.  See nav.h.
+
+#include "nav.h"
+#include "robot_logic.h"
+
+#define PH_FREE  0 // Straight until the wire
+#define PH_LEG   1 // Straight for leg_mm, then turn
+#define PH_SHIFT 2 // NAV_LANES: moving over to the next lane along the wire
+#define PH_START 3 // NAV_LANES: going to the wire where the first lane starts
+
+const char * nav_name[NAV_POLICIES]={"bounce", "random", "spiral", "lanes"};
+
+static int policy;
+static int phase;
+static int heading;      // Dead reckoning heading, degrees
+static int leg_heading;  // Heading the current leg or lane should have
+static long int leg_start, leg_mm;
+static int leg_count;
+static int side;         // NAV_LANES: direction of the turns at the wire, 1 left, -1 right
+static int sweeps;       // NAV_LANES: sweeps of the field finished
+static long int shift_over; // NAV_LANES: how far the last move over went past its end
+static unsigned long rnd_state=1;
+
+static int nav_random(int min, int max)
+{
+	rnd_state=rnd_state*1664525UL+1013904223UL;
+	return min+(int)((rnd_state>>16)%(unsigned long)(max-min+1));
+}
+
+static int wrap(int deg)
+{
+	deg%=360;
+	if(deg<0) deg+=360;
+	return deg;
+}
+
+static void start_leg(long int mm)
+{
+	leg_heading=heading;
+	leg_start=robot_travel();
+	leg_mm=mm;
+}
+
+// Back up from the wire before turning.  There are no sensors at the back,
+// so only do it if the robot drove forward since the last turn; otherwise
+// every try in a corner takes it closer to the wire behind it.
+static void back_off(void)
+{
+	if((robot_travel()-leg_start)>=NAV_BACK_MIN_MM)
+	{
+		robot_drive(-ROBOT_SPEED);
+		robot_wait(NAV_TURN_BACK_MS);
+	}
+	robot_stop();
+}
+
+// The robot is still rolling when a move over ends and the loop only checks
+// the distance between sensor readings, so shorten the next one by what the
+// last one overshot.
+static long int shift_mm(void)
+{
+	long int mm;
+
+	mm=NAV_LANE_MM-shift_over;
+	if(mm<NAV_LANE_MM/4) mm=NAV_LANE_MM/4;
+	return mm;
+}
+
+void nav_seed(unsigned long seed)
+{
+	rnd_state=seed?seed:1;
+}
+
+void nav_init(int p)
+{
+	policy=p;
+	heading=0;
+	leg_count=0;
+	side=1;
+	sweeps=0;
+	shift_over=0;
+	if(policy==NAV_SPIRAL)
+	{
+		phase=PH_LEG;
+		start_leg(NAV_LANE_MM);
+	}
+	else if(policy==NAV_LANES)
+	{
+		// Sweep the whole field from one side: go to the wire on the
+		// right first, the lanes then run along the start heading.
+		nav_turn(-90, ROBOT_SPEED);
+		phase=PH_START;
+		start_leg(0);
+	}
+	else
+	{
+		phase=PH_FREE;
+		start_leg(0);
+	}
+}
+
+void nav_turn(int deg, int speed)
+{
+	robot_turn(deg, speed);
+	heading=wrap(heading+deg);
+}
+
+int nav_heading(void)
+{
+	return heading;
+}
+
+void nav_step(void)
+{
+	int err;
+
+	// Patterns need the heading back after the turn towards a coin
+	if((policy==NAV_SPIRAL || policy==NAV_LANES) && (heading!=leg_heading))
+	{
+		err=wrap(leg_heading-heading);
+		if(err>180) err-=360;
+		nav_turn(err, ROBOT_SPEED_SLOW);
+	}
+
+	if((phase==PH_LEG || phase==PH_SHIFT) && (robot_travel()-leg_start)>=leg_mm)
+	{
+		robot_stop();
+		if(phase==PH_LEG)
+		{
+			// Square spiral: the legs grow by one lane every two turns
+			nav_turn(90, ROBOT_SPEED);
+			leg_count++;
+			start_leg((long int)(leg_count/2+1)*NAV_LANE_MM);
+		}
+		else
+		{
+			// Over the next lane: turn again to drive back across the field
+			nav_turn(90*side, ROBOT_SPEED);
+			shift_over=robot_travel()-leg_start-leg_mm;
+			side=-side;
+			phase=PH_FREE;
+			start_leg(0);
+		}
+	}
+	// Slow while moving over, the lanes come out closer to NAV_LANE_MM apart
+	robot_drive(phase==PH_SHIFT?ROBOT_SPEED_SLOW:ROBOT_SPEED);
+}
+
+// Angle between the robot and the normal to the wire, positive to the left.
+// With the reading falling exponentially with the distance, the difference
+// in distance is NAV_WIRE_DECAY_MM*ln(left/right), and ln(a/b) is close to
+// 2(a-b)/(a+b) for the small angles of a lane that is nearly square.
+static int wire_angle(int left, int right)
+{
+	long int deg;
+
+	if(left+right<=0) return 0;
+	deg=-(2L*NAV_WIRE_DECAY_MM*57L*(left-right))/((long int)NAV_SENSOR_GAP_MM*(left+right));
+	if(deg>NAV_ALIGN_MAX) deg=NAV_ALIGN_MAX;
+	if(deg<-NAV_ALIGN_MAX) deg=-NAV_ALIGN_MAX;
+	return (int)deg;
+}
+
+void nav_edge(int left, int right)
+{
+	int deg, align;
+
+	align=wire_angle(left, right);
+	left=(left>=EdgeThreshold);
+	right=(right>=EdgeThreshold2);
+
+	// The lanes reached the far side of the field.  Coins close to the wire
+	// along the lanes cannot be seen without hitting the wire first, so sweep
+	// again with lanes at right angles to the first ones.
+	if(policy==NAV_LANES && phase==PH_SHIFT && sweeps==0)
+	{
+		sweeps++;
+		back_off();
+		nav_turn(90*side, ROBOT_SPEED);
+		start_leg(shift_mm());
+		return;
+	}
+
+	// The spiral reached the wire or both sweeps are done: search the rest
+	// at random.
+	if((policy==NAV_SPIRAL && phase==PH_LEG) || (policy==NAV_LANES && phase==PH_SHIFT))
+	{
+		policy=NAV_RANDOM;
+		phase=PH_FREE;
+	}
+
+	switch(policy)
+	{
+		case NAV_RANDOM:
+			back_off();
+			deg=nav_random(NAV_RANDOM_MIN, NAV_RANDOM_MAX);
+			// Turn away from the side that saw the wire
+			if(left && !right) deg=-deg;
+			else if(left && right && nav_random(0, 1)) deg=-deg;
+			nav_turn(deg, ROBOT_SPEED_FAST);
+			start_leg(0);
+			break;
+
+		case NAV_LANES:
+			back_off();
+			nav_turn(90*side-align, ROBOT_SPEED);
+			if(phase==PH_START)
+			{
+				// At the wire on the right, turned back to the start heading
+				side=1;
+				phase=PH_FREE;
+				start_leg(0);
+			}
+			else
+			{
+				phase=PH_SHIFT;
+				start_leg(shift_mm());
+			}
+			break;
+
+		default:
+			robot_drive(-ROBOT_SPEED);
+			robot_wait(WALL_BACK_MS);
+			robot_stop();
+			nav_turn(WALL_TURN_DEG, ROBOT_SPEED_FAST);
+			robot_wait(200);
+			start_leg(0);
+			break;
+	}
+}
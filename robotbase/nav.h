@@ -0,0 +1,47 @@
+// nav.h:  Search patterns for the coin collecting robot.
+//
+// The robot used to drive straight until the perimeter wire and then always
+// turn by the same angle, which keeps retracing the same few paths.  This
+// module decides where to go next with one of these policies:
+//
+//   NAV_BOUNCE  The old behaviour: back up and turn WALL_TURN_DEG at the wire
+//   NAV_RANDOM  Turn away from the sensor that saw the wire by a random angle
+//   NAV_SPIRAL  Square spiral out from the start point, then NAV_RANDOM
+//   NAV_LANES   Back and forth lanes (boustrophedon) NAV_LANE_MM apart.  The
+//               robot must start square to the arena.
+//
+// Position comes from dead reckoning: the heading is the sum of the turns
+// commanded through this module and the length of each leg is measured with
+// robot_travel().  At the end of each lane the difference between the two
+// edge sensors gives the angle to the wire, which squares the next lane up.
+// Like robot_logic.c, this does not touch the hardware, so the same code runs
+// in Robot_Sim.c.
+
+#ifndef NAV_H
+#define NAV_H
+
+#define NAV_BOUNCE 0
+#define NAV_RANDOM 1
+#define NAV_SPIRAL 2
+#define NAV_LANES  3
+#define NAV_POLICIES 4
+
+#define NAV_LANE_MM      25 // A bit less than the width seen by the metal detector
+#define NAV_TURN_BACK_MS 150 // Back up from the wire before turning...
+#define NAV_BACK_MIN_MM  100 // ...if the robot drove at least this far since the last turn
+#define NAV_RANDOM_MIN   90 // Range of the random turns, in degrees
+#define NAV_RANDOM_MAX  200
+#define NAV_WIRE_DECAY_MM  40 // Edge sensor reading falls to 1/e every this far from the wire
+#define NAV_SENSOR_GAP_MM 110 // Distance between the two edge sensors
+#define NAV_ALIGN_MAX      20 // Largest heading correction at the wire, degrees
+
+void nav_init(int policy);
+void nav_seed(unsigned long seed);
+void nav_step(void);                // Call when nothing was detected, keeps the robot going
+void nav_edge(int left, int right); // Call with the edge sensor counts when they see the wire
+void nav_turn(int deg, int speed);  // Turn through here so the heading stays known
+int  nav_heading(void);             // Degrees from the start heading, 0 to 359
+
+extern const char * nav_name[NAV_POLICIES];
+
+#endif
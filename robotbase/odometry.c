@@ -0,0 +1,233 @@
+// odometry.c:  Encoder counting and PI speed/heading control.  See odometry.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "odometry.h"
+#include "motor.h"
+#include "delay.h"
+
+#define ODO_CONTROL_DIV 50 // The PI loop runs every 50ms...
+#define ODO_CONTROL_FREQ (1000/ODO_CONTROL_DIV) // ...that is 20 times per second
+
+// Controller gains, all with 8 fractional bits.  Duty is in 1/MOTOR_MAX units.
+#define ODO_KFF 1600  // Feed forward: duty per count/s (about 100% at 160 counts/s)
+#define ODO_KP   770  // 0.3% duty per count/s of error
+#define ODO_KI   130  // 0.05% duty per count/s per control period
+#define ODO_KH   512  // 2 counts/s of correction per count of heading error
+#define ODO_IMAX 2000 // Integrator clamp
+#define ODO_MIN_SPEED 20 // Slowest speed used near the end of a turn or move
+
+#define MODE_STOP  0
+#define MODE_DRIVE 1
+#define MODE_SPIN  2
+#define MODE_GOAL  3 // A turn or move that stops by itself
+
+static volatile long int enc[2];
+static volatile int wheel_dir[2]={1, 1}; // Last commanded direction of each wheel, sets the count sign
+static volatile unsigned char drive_on;
+static volatile unsigned char mode;
+static volatile int target;              // Requested speed in counts/s
+static volatile long int goal;           // Counts for MODE_GOAL
+static volatile unsigned long odo_ms;
+
+static long int enc_start[2], enc_last[2];
+static int speed[2], integ[2];
+static unsigned int last_port;
+static unsigned int ctl_count;
+
+static long int labs_(long int x)
+{
+	return (x<0)?-x:x;
+}
+
+static void control(void)
+{
+	int i, tgt[2], err, out[2];
+	long int delta, travelled[2], remaining, diff;
+
+	for(i=0; i<2; i++)
+	{
+		delta=labs_(enc[i]-enc_last[i]);
+		enc_last[i]=enc[i];
+		speed[i]+=(int)((delta*ODO_CONTROL_FREQ)-speed[i])/2;
+		travelled[i]=labs_(enc[i]-enc_start[i]);
+	}
+
+	if(mode==MODE_STOP)
+	{
+		integ[0]=integ[1]=0;
+		return;
+	}
+
+	tgt[0]=tgt[1]=target;
+
+	if(mode==MODE_GOAL)
+	{
+		remaining=goal-(travelled[0]+travelled[1])/2;
+		if(remaining<=0)
+		{
+			mode=MODE_STOP;
+			motor_stop(MOTOR_BRAKE);
+			integ[0]=integ[1]=0;
+			return;
+		}
+		// Slow down on the last stretch so the robot does not overshoot
+		if(remaining*ODO_CONTROL_FREQ/2<tgt[0])
+		{
+			tgt[0]=tgt[1]=remaining*ODO_CONTROL_FREQ/2;
+			if(tgt[0]<ODO_MIN_SPEED) tgt[0]=tgt[1]=ODO_MIN_SPEED;
+		}
+	}
+
+	// Heading: both wheels must travel the same distance
+	diff=travelled[0]-travelled[1];
+	tgt[0]-=(diff*ODO_KH)>>8;
+	tgt[1]+=(diff*ODO_KH)>>8;
+
+	for(i=0; i<2; i++)
+	{
+		if(tgt[i]<0) tgt[i]=0;
+		err=tgt[i]-speed[i];
+		integ[i]+=err;
+		if(integ[i]>ODO_IMAX) integ[i]=ODO_IMAX;
+		if(integ[i]<-ODO_IMAX) integ[i]=-ODO_IMAX;
+		out[i]=(tgt[i]*ODO_KFF+err*ODO_KP+integ[i]*ODO_KI)>>8;
+		if(out[i]<0) out[i]=0;
+		if(out[i]>MOTOR_MAX) out[i]=MOTOR_MAX;
+		out[i]*=wheel_dir[i];
+	}
+	motor_set(out[0], out[1]);
+}
+
+// Called every millisecond by the timer 3 interrupt in motor.c.  Only a
+// running drive command needs it, odo_ms is only read while one runs.
+int motor_tick(void)
+{
+	odo_ms++;
+	ctl_count++;
+	if(ctl_count>=ODO_CONTROL_DIV)
+	{
+		ctl_count=0;
+		if(drive_on) control();
+	}
+	return drive_on && (mode!=MODE_STOP);
+}
+
+// Counts every edge of both encoders
+void __ISR(_CHANGE_NOTICE_VECTOR, IPL6SOFT) CN_Handler(void)
+{
+	unsigned int port, changed;
+
+	port=PORTB; // Reading the port also clears the mismatch condition
+	changed=port^last_port;
+	last_port=port;
+	if(changed&(1<<7)) enc[0]+=wheel_dir[0];
+	if(changed&(1<<11)) enc[1]+=wheel_dir[1];
+	IFS1CLR=_IFS1_CNBIF_MASK;
+}
+
+void odo_init(void)
+{
+	// Encoder inputs
+	TRISB |= (1<<7)|(1<<11);
+	CNPUB |= (1<<7)|(1<<11);
+	CNCONBbits.ON = 1;
+	CNENB = (1<<7)|(1<<11);
+	last_port=PORTB;
+	IPC8bits.CNIP = 6;
+	IPC8bits.CNIS = 0;
+	IFS1bits.CNBIF = 0;
+	IEC1bits.CNBIE = 1;
+
+	INTCONbits.MVEC = 1; //Int multi-vector
+}
+
+static void odo_start(unsigned char new_mode, int dir0, int dir1, int speed_cmd)
+{
+	// The main loop calls MoveForward() every pass; do not reset the
+	// controller if nothing changed.
+	if(drive_on && (new_mode!=MODE_GOAL) && (mode==new_mode) && (target==speed_cmd) &&
+	   (wheel_dir[0]==dir0) && (wheel_dir[1]==dir1)) return;
+
+	IEC0bits.T3IE = 0; // Keep the control loop out while the command changes
+	wheel_dir[0]=dir0;
+	wheel_dir[1]=dir1;
+	enc_start[0]=enc[0];
+	enc_start[1]=enc[1];
+	integ[0]=integ[1]=0;
+	target=speed_cmd;
+	mode=new_mode;
+	drive_on=1;
+	IEC0bits.T3IE = 1;
+}
+
+void odo_drive(int speed_cmd)
+{
+	if(speed_cmd<0) odo_start(MODE_DRIVE, -1, -1, -speed_cmd);
+	else odo_start(MODE_DRIVE, 1, 1, speed_cmd);
+}
+
+void odo_spin(int speed_cmd)
+{
+	if(speed_cmd<0) odo_start(MODE_SPIN, 1, -1, -speed_cmd);
+	else odo_start(MODE_SPIN, -1, 1, speed_cmd);
+}
+
+void odo_turn(int deg, int speed_cmd)
+{
+	goal=ODO_DEG_TO_COUNTS((deg<0)?-deg:deg);
+	if(deg<0) odo_start(MODE_GOAL, 1, -1, speed_cmd);
+	else odo_start(MODE_GOAL, -1, 1, speed_cmd);
+}
+
+void odo_move(int mm, int speed_cmd)
+{
+	goal=ODO_MM_TO_COUNTS((mm<0)?-mm:mm);
+	if(mm<0) odo_start(MODE_GOAL, -1, -1, speed_cmd);
+	else odo_start(MODE_GOAL, 1, 1, speed_cmd);
+}
+
+void odo_stop(void)
+{
+	mode=MODE_STOP;
+	drive_on=0;
+	motor_stop(MOTOR_BRAKE);
+}
+
+int odo_busy(void)
+{
+	return mode==MODE_GOAL;
+}
+
+// Wait for a turn or move to finish.  If the wheels stop counting for
+// 'timeout_ms' (stalled, or encoders not connected) the motors are stopped
+// and 0 is returned.
+int odo_wait(unsigned int timeout_ms)
+{
+	unsigned long last_change;
+	long int c0, c1;
+
+	last_change=odo_ms;
+	c0=enc[0]; c1=enc[1];
+	while(odo_busy())
+	{
+		if((enc[0]!=c0) || (enc[1]!=c1))
+		{
+			c0=enc[0]; c1=enc[1];
+			last_change=odo_ms;
+		}
+		else if((odo_ms-last_change)>timeout_ms)
+		{
+			odo_stop();
+			return 0;
+		}
+		delay_idle(); // Nothing changes until the next encoder or motor interrupt
+	}
+	odo_stop();
+	return 1;
+}
+
+long int odo_count(int wheel)
+{
+	return enc[wheel&1];
+}
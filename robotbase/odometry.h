@@ -0,0 +1,46 @@
+// odometry.h:  Wheel encoder counting and closed loop drive for the robot.
+//
+// Each wheel has a slotted disk and an optical interrupter.  The outputs go to
+// RB7 (pin 16, wheel 1) and RB11 (pin 22, wheel 2) and every edge is counted
+// in the port B change notification interrupt.  The encoders have a single
+// channel, so the counting direction is taken from the commanded direction.
+//
+// A PI loop per wheel, run from the motor.c timer tick, sets the PWM duty
+// that holds the requested speed, plus a heading term that keeps the
+// distance travelled by both wheels equal.  Turns end when the wheels have
+// travelled the arc for the requested angle instead of after a fixed time.
+//
+// Wheel 1 is on RA0/RA1 (pins 2 and 3), wheel 2 on RB0/RB1 (pins 4 and 5),
+// see motor.h.  Call motor_init() before odo_init().  A positive turn is the
+// direction of the old TurnDirectionForCoin().
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+// Mechanical constants, measure them on the robot
+#define ODO_CPR             40  // Counts per wheel turn (20 slots, both edges)
+#define ODO_WHEEL_DIAM_MM   65
+#define ODO_WHEEL_BASE_MM  130  // Distance between the wheels
+
+// Counts each wheel travels when spinning in place by 'deg' degrees
+#define ODO_DEG_TO_COUNTS(deg) (((long int)(deg)*ODO_WHEEL_BASE_MM*ODO_CPR + 180L*ODO_WHEEL_DIAM_MM)/(360L*ODO_WHEEL_DIAM_MM))
+// Counts for a straight move of 'mm' millimeters (pi approximated as 355/113)
+#define ODO_MM_TO_COUNTS(mm) (((long int)(mm)*ODO_CPR*113L + 355L*ODO_WHEEL_DIAM_MM/2)/(355L*ODO_WHEEL_DIAM_MM))
+#define ODO_COUNTS_TO_MM(c) (((long int)(c)*355L*ODO_WHEEL_DIAM_MM)/(113L*ODO_CPR))
+
+// Speeds are in encoder counts per second
+#define ODO_SPEED_FAST   120
+#define ODO_SPEED_NORMAL  80
+#define ODO_SPEED_SLOW    40
+
+void odo_init(void);
+void odo_drive(int speed);   // Straight line, negative speed goes backwards
+void odo_spin(int speed);    // Spin in place until stopped, positive speed is a positive turn
+void odo_turn(int deg, int speed); // Spin in place by 'deg' degrees then stop
+void odo_move(int mm, int speed);  // Straight line for 'mm' millimeters then stop
+void odo_stop(void);
+int  odo_busy(void);         // 1 while a turn or move is in progress
+int  odo_wait(unsigned int timeout_ms);
+long int odo_count(int wheel);
+
+#endif
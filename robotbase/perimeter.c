@@ -0,0 +1,70 @@
+// perimeter.c:  Synchronous detection of the perimeter wire signal.  See
+// perimeter.h.
+
+#include <XC.h>
+#include <sys/attribs.h>
+#include "perimeter.h"
+#include "filter.h"
+
+static FILT_IQ iq[2]; // AN4, AN5
+static volatile int amplitude[2];
+
+// The buffer is split in two halves of 8 results (BUFM=1): the ADC fills one
+// while this reads the other, so there are 8 conversions (400us) to get here.
+// The scan goes AN4, AN5, AN4... so the even results are AN4.  The buffer
+// registers are 16 bytes apart.
+void __ISR(_ADC_VECTOR, IPL1SOFT) ADC_Handler(void)
+{
+	volatile unsigned int * buf;
+	int j, done;
+
+	done=0;
+	buf=AD1CON2bits.BUFS?&ADC1BUF0:&ADC1BUF8;
+	for(j=0; j<8; j+=2)
+	{
+		done=filt_iq_put(&iq[0], buf[j*4]);
+		filt_iq_put(&iq[1], buf[(j+1)*4]);
+	}
+	// Both detectors started together, so they finish together
+	if(done)
+	{
+		amplitude[0]=iq[0].out;
+		amplitude[1]=iq[1].out;
+	}
+	IFS0CLR=_IFS0_AD1IF_MASK; // After reading the buffer, or it fires again
+}
+
+void perim_init(void)
+{
+	AD1CON1CLR = 0x8000;    // ADC off to configure it
+	AD1CON1 = 0x0044;       // Timer 3 period match ends sampling and starts conversion, auto sample
+	AD1CON2 = 0x041E;       // AVDD/AVSS reference, scan inputs, interrupt every 8 conversions, split buffer
+	AD1CON3 = 0x0f01;       // TAD = 4*TPB, as ADCConf()
+	AD1CHS = 0;             // Negative input AVSS
+	AD1CSSL = (1<<4)|(1<<5);
+
+	filt_iq_init(&iq[0], PERIM_CYCLES);
+	filt_iq_init(&iq[1], PERIM_CYCLES);
+	amplitude[0]=amplitude[1]=0;
+
+	IPC5bits.AD1IP = 1;
+	IPC5bits.AD1IS = 0;
+	IFS0CLR=_IFS0_AD1IF_MASK;
+	IEC0SET=_IEC0_AD1IE_MASK;
+	INTCONbits.MVEC = 1;
+	AD1CON1SET = 0x8000;
+}
+
+void perim_stop(void)
+{
+	IEC0CLR=_IEC0_AD1IE_MASK;
+	AD1CON1CLR = 0x8000;
+	AD1CON2 = 0;
+	AD1CSSL = 0;
+	IFS0CLR=_IFS0_AD1IF_MASK;
+}
+
+int perim_amplitude(int an)
+{
+	return amplitude[an==5?1:0];
+}
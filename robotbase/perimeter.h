@@ -0,0 +1,42 @@
+// perimeter.h:  Synchronous detection of the perimeter wire signal on the
+// edge sensors, AN4 (RB2, pin 6) and AN5 (RB3, pin 7).
+//
+// The wire carries a tone at PERIM_FREQ.  Reading the sensors with ADCRead()
+// catches the tone at a random phase, so a single reading can be anywhere
+// between the two peaks.  Here the ADC converts AN4 and AN5 in turn on every
+// timer 3 period match, the same timer as the wheel PWM, so each sensor is
+// sampled at exactly PERIM_FS with no CPU time.  PERIM_FREQ must land on
+// PERIM_FS/4 (directly or aliased), where a quadrature detector (filt_iq_put()
+// in filter.c) gets the amplitude of the tone whatever its phase, with no
+// multiplications.  DC offsets cancel, and so does motor noise locked to the
+// PWM, which is always sampled at the same point of the PWM period.
+//
+// The ADC interrupt takes 4 samples per sensor each time, one cycle of the
+// detector.  The amplitude is the average over PERIM_CYCLES cycles, a new one
+// every 6.4ms.  The detector passes about PERIM_FS/4/PERIM_CYCLES = 150Hz
+// around PERIM_FREQ, so the generator must be within about 75Hz of it.
+//
+// ADCRead() must not be used between perim_init() and perim_stop().  After
+// perim_stop() the ADC has to be set up again with ADCConf().
+
+#ifndef PERIMETER_H
+#define PERIMETER_H
+
+#include "motor.h"
+
+#define PERIM_FREQ   12500L                // The wire generator
+#define PERIM_FS     (MOTOR_PWM_FREQ/2)    // Samples per second per sensor, two sensors share the ADC
+#define PERIM_CYCLES 16                    // Detector cycles per amplitude, at most FILT_IQ_MAX
+
+// 4*PERIM_FREQ/PERIM_FS must be an odd whole number: 1 or 3 for no aliasing,
+// 5 and up lets the ADC undersample a tone above PERIM_FS/2.  If the wire
+// frequency does not work with the PWM frequency, move MOTOR_PWM_FREQ.
+#if ((4*PERIM_FREQ)%PERIM_FS!=0) || ((((4*PERIM_FREQ)/PERIM_FS)&1)==0)
+	#error PERIM_FREQ is not at PERIM_FS/4, aliased or not
+#endif
+
+void perim_init(void); // After motor_init(), timer 3 must be running
+void perim_stop(void);
+int  perim_amplitude(int an); // AN4 or AN5, peak to peak in ADC counts
+
+#endif
@@ -0,0 +1,93 @@
+// robot_logic.c:  Coin collecting strategy.  See robot_logic.h.
+
+#include "robot_logic.h"
+#include "nav.h"
+#include "arm.h"
+
+static void arm_wait(void)
+{
+	while(arm_busy()) robot_wait(ARM_FRAME_MS);
+}
+
+// Pick up the coin once the robot is in place and the arm is ready.  Returns
+// 1 if the coin was picked up.  The arm goes back home in the background.
+static int pickup(void)
+{
+	int t, contact;
+
+	arm_wait();
+	robot_arm(ARM_LOWER);
+	arm_wait();
+
+	// Stay down until the contacts on the magnet see the coin
+	contact=robot_contact();
+	for(t=0; (contact<=0) && (t<ARM_DWELL_MS); t+=ARM_FRAME_MS)
+	{
+		robot_wait(ARM_FRAME_MS);
+		contact=robot_contact();
+	}
+	if(contact==0)
+	{
+		// Missed it, no need to go over the bin
+		robot_magnet(0);
+		robot_arm(ARM_HOME);
+		return 0;
+	}
+
+	robot_arm(ARM_BIN);
+	arm_wait();
+	robot_magnet(0);
+	robot_wait(ARM_RELEASE_MS);
+	robot_arm(ARM_HOME);
+	return 1;
+}
+
+// Drive around picking up coins until all of them are collected, searching
+// with one of the nav.h policies.  Returns the number of coins picked up.
+int robot_run(int policy)
+{
+	int coins=0;
+	int edge, edge2, coin, last_coin=0;
+
+	robot_show_coins(coins);
+	nav_init(policy);
+
+	while(coins<ROBOT_COINS)
+	{
+		edge=robot_edge(0);
+		edge2=robot_edge(1);
+		coin=robot_coin();
+
+		// Only a new detection is a new coin.  If the arm missed, the coin
+		// can still be under the detector and must not be counted again.
+		if(coin && !last_coin)
+		{
+			robot_event(ROBOT_EV_COIN);
+			// The arm gets ready while the robot backs up and turns
+			robot_arm(ARM_PREPARE);
+			robot_magnet(1);
+			robot_drive(-ROBOT_SPEED);
+			robot_wait(COIN_BACK_MS);
+			robot_stop();
+			nav_turn(COIN_TURN_DEG, ROBOT_SPEED_SLOW);
+			if(pickup())
+			{
+				coins++;
+				robot_show_coins(coins);
+			}
+			coin=robot_coin();
+		}
+		else if((edge>=EdgeThreshold) || (edge2>=EdgeThreshold2))
+		{
+			robot_event(ROBOT_EV_EDGE);
+			nav_edge(edge, edge2);
+		}
+		else
+		{
+			nav_step();
+		}
+		last_coin=coin;
+	}
+
+	return coins;
+}
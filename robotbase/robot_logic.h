@@ -0,0 +1,76 @@
+// robot_logic.h:  The coin collecting strategy of the robot, separated from
+// the hardware so the same code runs in the robot (Robot_Base.c) and in the
+// PC simulator (Robot_Sim.c).  The logic only talks to the world through the
+// platform functions declared at the end of this file.
+
+#ifndef ROBOT_LOGIC_H
+#define ROBOT_LOGIC_H
+
+#define ROBOT_COINS 20 // Coins in the field, the mission ends after picking them all
+#define ROBOT_NAV NAV_LANES // Search pattern, see nav.h
+
+// The sensing path works in raw ADC counts.  This turns volts into counts at
+// compile time, so no floating point math (software emulated in the PIC32MX)
+// runs in the control loop.
+#define ADC_VREF 3.3
+#define ADC_FULL_SCALE 1023
+#define VOLTS_TO_ADC(v) ((int)(((v)*ADC_FULL_SCALE)/ADC_VREF+0.5))
+
+// getEdge() used to return the voltage truncated to an int, so the threshold
+// actually in effect for both sensors was 1.0V.
+#define EdgeVoltage 1.0
+#define EdgeVoltage2 1.0
+
+// Set EDGE_SYNC to 1 to read the edge sensors with the synchronous detector
+// in perimeter.c: the peak to peak amplitude of the wire tone, in ADC counts,
+// updated in the background every 6.4ms.  That is not the same reading as
+// ADCRead(), so it has its own threshold.  EdgeSyncVoltage has not been
+// measured yet: watch the edge readings at the wire (tlm_edge()) and set it
+// before turning EDGE_SYNC on.
+#define EDGE_SYNC 0
+#define EdgeSyncVoltage 1.0
+
+#if EDGE_SYNC
+	#define EdgeThreshold VOLTS_TO_ADC(EdgeSyncVoltage)
+	#define EdgeThreshold2 VOLTS_TO_ADC(EdgeSyncVoltage)
+#else
+	#define EdgeThreshold VOLTS_TO_ADC(EdgeVoltage)
+	#define EdgeThreshold2 VOLTS_TO_ADC(EdgeVoltage2)
+#endif
+
+// Motions, speeds in encoder counts per second (see odometry.h)
+#define ROBOT_SPEED      80
+#define ROBOT_SPEED_SLOW 40
+#define ROBOT_SPEED_FAST 120
+#define COIN_BACK_MS     230 // Back up before turning to the coin
+#define COIN_TURN_DEG    12
+#define WALL_BACK_MS     675 // Back up from the perimeter wire
+#define WALL_TURN_DEG    45
+
+// Coin pickup
+#define ARM_DWELL_MS     300 // Longest wait with the magnet on the coin
+#define ARM_RELEASE_MS   200 // For the coin to drop before the arm swings back
+
+// Events for robot_event()
+#define ROBOT_EV_EDGE 1
+#define ROBOT_EV_COIN 2
+
+int robot_run(int policy);
+
+/* -------------------------------------------------------------------------- */
+/* Platform functions, implemented by Robot_Base.c and by Robot_Sim.c         */
+/* -------------------------------------------------------------------------- */
+extern int  robot_edge(int sensor);          // ADC counts: 0 is AN5 (left), 1 is AN4 (right)
+extern int  robot_coin(void);                // 1 if a coin is under the detector
+extern void robot_drive(int speed);          // Straight, negative goes backwards
+extern void robot_stop(void);
+extern void robot_turn(int deg, int speed);  // Spin in place, returns when done
+extern void robot_wait(int ms);
+extern void robot_arm(int move);             // Start one of the arm.h moves
+extern void robot_magnet(int on);
+extern int  robot_contact(void);             // 1 if a coin is on the magnet, -1 if the robot cannot tell
+extern void robot_show_coins(int coins);
+extern void robot_event(int event);
+extern long int robot_travel(void);          // Millimeters driven, backwards counts as negative
+
+#endif
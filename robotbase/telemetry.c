@@ -0,0 +1,168 @@
+// telemetry.c:  Framed binary telemetry for the robot.  See telemetry.h for
+// the frame format.  Timestamps come from timers 4 and 5 combined as a free
+// running 32-bit timer clocked from PBCLK/256 (6.4us per tick at 40MHz), so
+// they keep counting while the core timer is being reset by the delay and
+// period measuring functions.  When clock_set() changes PBCLK the prescaler
+// is changed to keep the tick rate, or as close as it gets.
+
+#include <XC.h>
+#include "telemetry.h"
+#include "clock.h"
+
+#define TLM_TICK_HZ (CLOCK_FAST_HZ/256L)
+
+// Timer 4 prescaler for each TCKPS value
+static const unsigned int tlm_prescale[8]={1, 2, 4, 8, 16, 32, 64, 256};
+static unsigned long tick_hz=TLM_TICK_HZ;
+
+static const unsigned short crc16_ccitt_table[256] = {
+    0x0000U, 0x1021U, 0x2042U, 0x3063U, 0x4084U, 0x50A5U, 0x60C6U, 0x70E7U,
+    0x8108U, 0x9129U, 0xA14AU, 0xB16BU, 0xC18CU, 0xD1ADU, 0xE1CEU, 0xF1EFU,
+    0x1231U, 0x0210U, 0x3273U, 0x2252U, 0x52B5U, 0x4294U, 0x72F7U, 0x62D6U,
+    0x9339U, 0x8318U, 0xB37BU, 0xA35AU, 0xD3BDU, 0xC39CU, 0xF3FFU, 0xE3DEU,
+    0x2462U, 0x3443U, 0x0420U, 0x1401U, 0x64E6U, 0x74C7U, 0x44A4U, 0x5485U,
+    0xA56AU, 0xB54BU, 0x8528U, 0x9509U, 0xE5EEU, 0xF5CFU, 0xC5ACU, 0xD58DU,
+    0x3653U, 0x2672U, 0x1611U, 0x0630U, 0x76D7U, 0x66F6U, 0x5695U, 0x46B4U,
+    0xB75BU, 0xA77AU, 0x9719U, 0x8738U, 0xF7DFU, 0xE7FEU, 0xD79DU, 0xC7BCU,
+    0x48C4U, 0x58E5U, 0x6886U, 0x78A7U, 0x0840U, 0x1861U, 0x2802U, 0x3823U,
+    0xC9CCU, 0xD9EDU, 0xE98EU, 0xF9AFU, 0x8948U, 0x9969U, 0xA90AU, 0xB92BU,
+    0x5AF5U, 0x4AD4U, 0x7AB7U, 0x6A96U, 0x1A71U, 0x0A50U, 0x3A33U, 0x2A12U,
+    0xDBFDU, 0xCBDCU, 0xFBBFU, 0xEB9EU, 0x9B79U, 0x8B58U, 0xBB3BU, 0xAB1AU,
+    0x6CA6U, 0x7C87U, 0x4CE4U, 0x5CC5U, 0x2C22U, 0x3C03U, 0x0C60U, 0x1C41U,
+    0xEDAEU, 0xFD8FU, 0xCDECU, 0xDDCDU, 0xAD2AU, 0xBD0BU, 0x8D68U, 0x9D49U,
+    0x7E97U, 0x6EB6U, 0x5ED5U, 0x4EF4U, 0x3E13U, 0x2E32U, 0x1E51U, 0x0E70U,
+    0xFF9FU, 0xEFBEU, 0xDFDDU, 0xCFFCU, 0xBF1BU, 0xAF3AU, 0x9F59U, 0x8F78U,
+    0x9188U, 0x81A9U, 0xB1CAU, 0xA1EBU, 0xD10CU, 0xC12DU, 0xF14EU, 0xE16FU,
+    0x1080U, 0x00A1U, 0x30C2U, 0x20E3U, 0x5004U, 0x4025U, 0x7046U, 0x6067U,
+    0x83B9U, 0x9398U, 0xA3FBU, 0xB3DAU, 0xC33DU, 0xD31CU, 0xE37FU, 0xF35EU,
+    0x02B1U, 0x1290U, 0x22F3U, 0x32D2U, 0x4235U, 0x5214U, 0x6277U, 0x7256U,
+    0xB5EAU, 0xA5CBU, 0x95A8U, 0x8589U, 0xF56EU, 0xE54FU, 0xD52CU, 0xC50DU,
+    0x34E2U, 0x24C3U, 0x14A0U, 0x0481U, 0x7466U, 0x6447U, 0x5424U, 0x4405U,
+    0xA7DBU, 0xB7FAU, 0x8799U, 0x97B8U, 0xE75FU, 0xF77EU, 0xC71DU, 0xD73CU,
+    0x26D3U, 0x36F2U, 0x0691U, 0x16B0U, 0x6657U, 0x7676U, 0x4615U, 0x5634U,
+    0xD94CU, 0xC96DU, 0xF90EU, 0xE92FU, 0x99C8U, 0x89E9U, 0xB98AU, 0xA9ABU,
+    0x5844U, 0x4865U, 0x7806U, 0x6827U, 0x18C0U, 0x08E1U, 0x3882U, 0x28A3U,
+    0xCB7DU, 0xDB5CU, 0xEB3FU, 0xFB1EU, 0x8BF9U, 0x9BD8U, 0xABBBU, 0xBB9AU,
+    0x4A75U, 0x5A54U, 0x6A37U, 0x7A16U, 0x0AF1U, 0x1AD0U, 0x2AB3U, 0x3A92U,
+    0xFD2EU, 0xED0FU, 0xDD6CU, 0xCD4DU, 0xBDAAU, 0xAD8BU, 0x9DE8U, 0x8DC9U,
+    0x7C26U, 0x6C07U, 0x5C64U, 0x4C45U, 0x3CA2U, 0x2C83U, 0x1CE0U, 0x0CC1U,
+    0xEF1FU, 0xFF3EU, 0xCF5DU, 0xDF7CU, 0xAF9BU, 0xBFBAU, 0x8FD9U, 0x9FF8U,
+    0x6E17U, 0x7E36U, 0x4E55U, 0x5E74U, 0x2E93U, 0x3EB2U, 0x0ED1U, 0x1EF0U
+};
+
+static unsigned short crc16_ccitt(unsigned char val, unsigned short crc)
+{
+    unsigned short tmp;
+
+    tmp = (crc >> 8) ^ val;
+    crc = ((unsigned short)(crc << 8U)) ^ crc16_ccitt_table[tmp];
+    return crc;
+}
+
+static void tlm_putc(unsigned char c)
+{
+    while( U2STAbits.UTXBF); // wait while TX buffer full
+    U2TXREG = c; // send single character to transmit buffer
+}
+
+// Timers 4 and 5 as one 32-bit timer.  UART2 must be configured before
+// calling this function, since it also sends the clock message.
+void tlm_init(void)
+{
+	T4CON = 0;
+	T5CON = 0;
+	T4CONbits.T32 = 1;   // TMR4:TMR5 form a 32-bit timer
+	T4CONbits.TCKPS = 7; // 1:256 prescale value
+	TMR4 = 0;
+	PR4 = 0xffffffff;
+	tlm_clock(clock_hz());
+	T4CONbits.ON = 1;
+
+	tlm_send_clock();
+}
+
+// The largest prescaler that still gives at least TLM_TICK_HZ.  40MHz/256 and
+// 10MHz/64 are both exactly TLM_TICK_HZ.
+void tlm_clock(unsigned long pbclk)
+{
+	int ps=7;
+	unsigned int on=T4CONbits.ON;
+
+	while((ps>0) && ((pbclk/tlm_prescale[ps])<TLM_TICK_HZ)) ps--;
+	T4CONbits.ON = 0;
+	T4CONbits.TCKPS = ps;
+	T4CONbits.ON = on;
+	tick_hz=pbclk/tlm_prescale[ps];
+}
+
+void tlm_send_clock(void)
+{
+	unsigned char buf[4];
+
+	buf[0]=tick_hz; buf[1]=tick_hz>>8; buf[2]=tick_hz>>16; buf[3]=tick_hz>>24;
+	tlm_send(TLM_ID_CLOCK, buf, 4);
+}
+
+unsigned long tlm_timestamp(void)
+{
+	return TMR4; // In 32-bit mode TMR4 holds the full count
+}
+
+void tlm_send(unsigned char id, const unsigned char * payload, unsigned char len)
+{
+	unsigned char j, c;
+	unsigned short crc=0;
+	unsigned long t;
+
+	if(len>TLM_MAX_PAYLOAD) len=TLM_MAX_PAYLOAD;
+	t=tlm_timestamp();
+
+	tlm_putc(TLM_SYNC);
+	tlm_putc(id);
+	crc=crc16_ccitt(id, crc);
+	tlm_putc(len);
+	crc=crc16_ccitt(len, crc);
+	for(j=0; j<4; j++)
+	{
+		c=t>>(j*8);
+		tlm_putc(c);
+		crc=crc16_ccitt(c, crc);
+	}
+	for(j=0; j<len; j++)
+	{
+		tlm_putc(payload[j]);
+		crc=crc16_ccitt(payload[j], crc);
+	}
+	tlm_putc(crc/0x100); // Send high byte of CRC
+	tlm_putc(crc%0x100); // Send low byte of CRC
+}
+
+void tlm_edge(unsigned int an5, unsigned int an4)
+{
+	unsigned char buf[4];
+
+	buf[0]=an5; buf[1]=an5>>8;
+	buf[2]=an4; buf[3]=an4>>8;
+	tlm_send(TLM_ID_EDGE, buf, 4);
+}
+
+void tlm_period(unsigned long period)
+{
+	unsigned char buf[4];
+
+	buf[0]=period; buf[1]=period>>8; buf[2]=period>>16; buf[3]=period>>24;
+	tlm_send(TLM_ID_PERIOD, buf, 4);
+}
+
+void tlm_coins(unsigned int coins)
+{
+	unsigned char buf[2];
+
+	buf[0]=coins; buf[1]=coins>>8;
+	tlm_send(TLM_ID_COINS, buf, 2);
+}
+
+void tlm_event(unsigned char event)
+{
+	tlm_send(TLM_ID_EVENT, &event, 1);
+}
@@ -0,0 +1,47 @@
+// telemetry.h:  Compact framed binary telemetry sent over UART2.  Replaces
+// the printf() debug output of Robot_Base.c so the control loop is not slowed
+// down by soft-float formatting.  This header is also included by the host
+// side decoder (Telemetry_Decoder.c) so both ends agree on the format.
+//
+// Frame layout (all frames):
+//
+//   SYNC | ID | LEN | TIMESTAMP (4 bytes, LSB first) | PAYLOAD (LEN bytes) | CRC (2 bytes, MSB first)
+//
+// The CRC is CRC-16/CCITT (XModem, initial value 0x0000), the same one used by
+// PIC32_Receiver.c and Computer_Sender.c, computed from ID to the last byte of
+// the payload.  Multi-byte payload fields are sent LSB first.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#define TLM_SYNC        0xA5
+#define TLM_MAX_PAYLOAD 16
+#define TLM_HEADER_LEN  7  // SYNC, ID, LEN and the 4 timestamp bytes
+#define TLM_CRC_LEN     2
+
+// Message IDs and their payloads
+#define TLM_ID_CLOCK    0x01 // u32: timestamp ticks per second from now on (sent by tlm_init() and clock_set())
+#define TLM_ID_EDGE     0x02 // u16: AN5 ADC count, u16: AN4 ADC count
+#define TLM_ID_PERIOD   0x03 // u32: coin oscillator period (40MHz ticks, 4 fractional bits)
+#define TLM_ID_COINS    0x04 // u16: number of coins collected
+#define TLM_ID_EVENT    0x05 // u8: one of the TLM_EV_xxx codes below
+
+// Event codes for TLM_ID_EVENT
+#define TLM_EV_START    0x00
+#define TLM_EV_EDGE     0x01
+#define TLM_EV_COIN     0x02
+#define TLM_EV_DONE     0x03
+
+#ifndef TLM_HOST_ONLY
+void tlm_init(void);
+void tlm_clock(unsigned long pbclk); // New PBCLK, called by clock_set()
+void tlm_send_clock(void);
+unsigned long tlm_timestamp(void);
+void tlm_send(unsigned char id, const unsigned char * payload, unsigned char len);
+void tlm_edge(unsigned int an5, unsigned int an4);
+void tlm_period(unsigned long period);
+void tlm_coins(unsigned int coins);
+void tlm_event(unsigned char event);
+#endif
+
+#endif
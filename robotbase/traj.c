@@ -0,0 +1,78 @@
+// traj.c:  Trapezoidal velocity profiles.  See traj.h.
+
+#include "traj.h"
+
+static long int isqrt(unsigned long x)
+{
+	unsigned long r=0, bit=1UL<<30;
+
+	while(bit>x) bit>>=2;
+	while(bit)
+	{
+		if(x>=r+bit)
+		{
+			x-=r+bit;
+			r=(r>>1)+bit;
+		}
+		else r>>=1;
+		bit>>=2;
+	}
+	return (long int)r;
+}
+
+void traj_init(TRAJ * t, int pos)
+{
+	t->pos=t->target=(long int)pos<<TRAJ_FRAC;
+	t->vel=0;
+	t->vmax=t->amax=1;
+}
+
+// A new target while moving keeps the current speed, so moves blend into
+// each other.
+void traj_go(TRAJ * t, int target, long int vmax, long int amax)
+{
+	t->target=(long int)target<<TRAJ_FRAC;
+	t->vmax=(vmax>0)?vmax:1;
+	t->amax=(amax>0)?amax:1;
+}
+
+int traj_frame(TRAJ * t)
+{
+	long int rem, dir, v, vstop;
+
+	rem=t->target-t->pos;
+	if(rem==0 && t->vel==0) return 0;
+
+	dir=(rem>=0)?1:-1;
+	v=t->vel*dir;   // Speed towards the target, negative if moving away
+	rem*=dir;
+
+	// Fastest speed that can still stop at the target slowing down by amax
+	// every frame: v+(v-a)+(v-2a)+... = v*v/(2a)+v/2 <= d
+	vstop=isqrt((unsigned long)(2*t->amax)*(unsigned long)rem+(unsigned long)(t->amax*t->amax)/4)-t->amax/2;
+
+	if(v<0) v+=t->amax; // Going the wrong way (blended move), turn around first
+	else
+	{
+		v+=t->amax;
+		if(v>t->vmax) v=t->vmax;
+		if(v>vstop) v=vstop;
+		if(v<t->amax) v=t->amax; // Do not crawl over the last fraction of a count
+	}
+
+	if(v>=rem)
+	{
+		// Lands on the target this frame
+		t->pos=t->target;
+		t->vel=0;
+		return 0;
+	}
+	t->pos+=v*dir;
+	t->vel=v*dir;
+	return 1;
+}
+
+int traj_pos(TRAJ * t)
+{
+	return (int)((t->pos+(1L<<(TRAJ_FRAC-1)))>>TRAJ_FRAC);
+}
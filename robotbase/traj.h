@@ -0,0 +1,33 @@
+// traj.h:  Trapezoidal velocity profiles for the arm servos.
+//
+// A servo told to jump to a new position goes there as fast as it can and
+// overshoots, and the arm shakes until it settles.  Here each servo setpoint
+// is moved once per servo frame with the acceleration and speed limited, so
+// the arm speeds up, cruises and slows down to stop right on the target: the
+// fastest move the limits allow, with nothing to wait for at the end.
+//
+// Positions are in servo timer counts (10us) and times in frames (20ms).
+// Internally everything has TRAJ_FRAC fractional bits.  Integer only, so it
+// runs inside the servo interrupt and in Robot_Sim.c.
+
+#ifndef TRAJ_H
+#define TRAJ_H
+
+#define TRAJ_FRAC 8
+
+typedef struct {
+	long int pos, vel;    // Setpoint and its speed, with TRAJ_FRAC fractional bits
+	long int target;
+	long int vmax, amax;  // Counts/frame and counts/frame/frame, with TRAJ_FRAC fractional bits
+} TRAJ;
+
+// Limits in whole counts, per second and per second squared
+#define TRAJ_VEL(counts_per_s) ((long int)(counts_per_s)*(1L<<TRAJ_FRAC)/50)
+#define TRAJ_ACC(counts_per_s2) ((long int)(counts_per_s2)*(1L<<TRAJ_FRAC)/2500)
+
+void traj_init(TRAJ * t, int pos);
+void traj_go(TRAJ * t, int target, long int vmax, long int amax);
+int  traj_frame(TRAJ * t);  // Advance one frame, returns 1 while still moving
+int  traj_pos(TRAJ * t);
+
+#endif